@@ -0,0 +1,467 @@
+// ECGSynth.cpp : synthetic transmission generator.
+//
+// Writes a WAV file with a complete transmission as Convert2ECG decodes it
+// (header sweep, calibration, serial number, FM data section) and a truth
+// file of the ECG values. With -a, compares a converted .ecg file with the
+// truth file and prints the decode accuracy as JSON.
+//
+// usage: ECGSynth.exe out.wav [options]
+//        ECGSynth.exe -a truthFile ecgFile
+//
+
+#include "stdafx.h"
+#include "WaveFormat.h"
+
+#define _USE_MATH_DEFINES
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static const double ToneLevel = 0.5;			// amplitude of the carrier. (full scale 1.0)
+static const double DataRate = 450.0;			// data samples per sec.
+static const int CenterFrequency = 1700;		// ECG value = 1700 - f. (outECG)
+static const int SerialLowF = 1366;				// bit 0
+static const int SerialHighF = 2035;			// bit 1
+static const int WriteBlock = 65536;			// samples per write.
+static const long long MaxSamples = (0xFFFFFFFFLL - 36) / 2;	// 16 bit, the RIFF size is 32 bit.
+
+struct synthConfig {
+	int		samplingRate;
+	int		serialNo;
+	double	dataTime;						// sec
+	double	heartRate;						// bpm
+	double	snr;							// dB, < 0: no noise.
+	double	dropoutRate;					// per minute
+	double	dropoutTime;					// sec
+	double	driftPpm;						// transmitter clock error.
+	double	leadInTime;						// sec of silence before the header.
+	unsigned int seed;
+	std::string wavPath;
+	std::string truthPath;
+};
+
+/*
+ Phase continuous tone writer. Noise, dropouts and clock drift are applied
+ here, the transmission is described in nominal frequencies / durations.
+ */
+class SynthWriter
+{
+private:
+	const synthConfig &cfg;
+	std::ofstream fs;
+	std::vector<short> block;
+	std::mt19937 rng;
+	std::normal_distribution<double> noise;
+	std::exponential_distribution<double> dropoutGap;
+	double	noiseSigma;
+	double	clock;							// transmitter time scale. (1 + drift)
+	double	phase;
+	double	residue;						// fraction of a sample carried to the next tone.
+	long long samples;
+	bool	overflow;						// over MaxSamples, the rest is not written.
+	long long nextDropout;					// sample index of the next dropout.
+	long long dropoutEnd;
+
+	void put(double x);
+	void scheduleDropout(void);
+
+public:
+	SynthWriter(const synthConfig &config);
+	int open(void);
+	int close(void);
+	void tone(double sec, double f0, double f1);
+	void silence(double sec) { tone(sec, 0.0, 0.0); }
+	long long getSamples(void) { return samples; }
+};
+
+SynthWriter::SynthWriter(const synthConfig &config) : cfg(config), rng(config.seed)
+{
+	noiseSigma = (cfg.snr < 0.0) ? 0.0 : ToneLevel / sqrt(2.0) / pow(10.0, cfg.snr / 20.0);
+	clock = 1.0 + cfg.driftPpm * 1.0e-6;
+	phase = 0.0;
+	residue = 0.0;
+	samples = 0;
+	overflow = false;
+	nextDropout = dropoutEnd = -1;
+	if (cfg.dropoutRate > 0.0)
+		dropoutGap = std::exponential_distribution<double>(cfg.dropoutRate / 60.0);
+}
+
+int SynthWriter::open(void)
+{
+	fs.open(cfg.wavPath.c_str(), std::ios::out | std::ios::binary);
+	if (fs.fail()) {
+		std::cerr << "Error! cannot create output file:" << cfg.wavPath << "\n";
+		return -1;
+	}
+	// sizes are written by close().
+	char header[44];
+	memset(header, 0, sizeof(header));
+	fs.write(header, sizeof(header));
+	block.reserve(WriteBlock);
+	scheduleDropout();
+	return 0;
+}
+
+int SynthWriter::close(void)
+{
+	if (!block.empty())
+		fs.write((const char *)&block[0], block.size() * sizeof(short));
+	block.clear();
+
+	_chankHeader chk;
+	_fmtChunk fmt;
+	__int32 tagWave = CHANK_WAVE;
+	if (overflow) {
+		fs.close();
+		remove(cfg.wavPath.c_str());		// the header would be wrong.
+		std::cerr << "Error! output is over 4GB, a WAV file cannot hold it:" << cfg.wavPath << "\n";
+		return -1;
+	}
+	unsigned __int32 dataBytes = (unsigned __int32)(samples * sizeof(short));
+
+	fs.seekp(0);
+	chk.chankIdVal = CHANK_RIFF;
+	chk.chankSize = 4 + (sizeof(chk) + sizeof(fmt)) + sizeof(chk) + dataBytes;
+	fs.write((const char *)&chk, sizeof(chk));
+	fs.write((const char *)&tagWave, sizeof(tagWave));
+	chk.chankIdVal = CHANK_fmt;
+	chk.chankSize = sizeof(fmt);
+	fs.write((const char *)&chk, sizeof(chk));
+	fmt.wFormatTag = 1;
+	fmt.wChannels = 1;
+	fmt.dwSamplesPerSec = cfg.samplingRate;
+	fmt.dwAvgBytesPerSec = cfg.samplingRate * sizeof(short);
+	fmt.wBlockAlign = sizeof(short);
+	fmt.wBitsPerSample = 16;
+	fs.write((const char *)&fmt, sizeof(fmt));
+	chk.chankIdVal = CHANK_data;
+	chk.chankSize = dataBytes;
+	fs.write((const char *)&chk, sizeof(chk));
+	fs.close();
+	if (fs.fail()) {
+		std::cerr << "Error! cannot write output file:" << cfg.wavPath << "\n";
+		return -1;
+	}
+	return 0;
+}
+
+void SynthWriter::scheduleDropout(void)
+{
+	if (cfg.dropoutRate <= 0.0)
+		return;
+	nextDropout = samples + (long long)(dropoutGap(rng) * cfg.samplingRate) + 1;
+	dropoutEnd = nextDropout + (long long)(cfg.dropoutTime * cfg.samplingRate);
+}
+
+void SynthWriter::put(double x)
+{
+	if (samples >= MaxSamples) {
+		overflow = true;
+		return;
+	}
+	if (nextDropout >= 0 && samples >= nextDropout) {
+		x = 0.0;							// carrier lost, the noise stays.
+		if (samples + 1 >= dropoutEnd)
+			scheduleDropout();
+	}
+	if (noiseSigma > 0.0)
+		x += noiseSigma * noise(rng);
+	int v = (int)floor(x * SHRT_MAX + 0.5);
+	if (v > SHRT_MAX) v = SHRT_MAX;
+	if (v < -SHRT_MAX) v = -SHRT_MAX;
+	block.push_back((short)v);
+	samples++;
+	if ((int)block.size() >= WriteBlock) {
+		fs.write((const char *)&block[0], block.size() * sizeof(short));
+		block.clear();
+	}
+}
+
+/*
+ sec of the transmitter clock, linear sweep f0 --> f1. (0Hz: silence)
+ */
+void SynthWriter::tone(double sec, double f0, double f1)
+{
+	double len = sec / clock * cfg.samplingRate + residue;
+	int n = (int)len;
+	residue = len - n;
+	for (int i=0; i<n; i++) {
+		double f = (f0 + (f1 - f0) * i / n) * clock;
+		put((f > 0.0) ? ToneLevel * sin(phase) : 0.0);
+		phase += 2.0*M_PI*f / cfg.samplingRate;
+		if (phase > 2.0*M_PI)
+			phase -= 2.0*M_PI;
+	}
+}
+
+/*
+ ECG value (Hz below 1700) at t: PQRST waves of gaussians + baseline wander.
+ */
+static double ecgValue(double t, double heartRate)
+{
+	static const struct { double pos, width, level; } waves[] = {
+		{ 0.16, 0.025,  25.0 },			// P
+		{ 0.26, 0.010, -40.0 },			// Q
+		{ 0.28, 0.012, 300.0 },			// R
+		{ 0.30, 0.010, -80.0 },			// S
+		{ 0.52, 0.040,  60.0 },			// T
+	};
+	double beat = 60.0 / heartRate;
+	double ph = fmod(t, beat) / beat;
+	double v = 20.0 * sin(2.0*M_PI*0.3*t);
+	for (int i=0; i<(int)(sizeof(waves)/sizeof(waves[0])); i++) {
+		double d = (ph - waves[i].pos) / waves[i].width;
+		v += waves[i].level * exp(-0.5*d*d);
+	}
+	return v;
+}
+
+static int synthesize(const synthConfig &cfg)
+{
+	SynthWriter wr(cfg);
+	std::ofstream truth;
+	int dataSamples = (int)(cfg.dataTime * DataRate);
+
+	truth.open(cfg.truthPath.c_str(), std::ios::out);
+	if (truth.fail()) {
+		std::cerr << "Error! cannot create truth file:" << cfg.truthPath << "\n";
+		return -1;
+	}
+	if (wr.open())
+		return -1;
+
+	// header: lead-in tone, sweep up, end mark.
+	wr.silence(cfg.leadInTime);
+	wr.tone(0.3, 1200, 1200);
+	wr.tone(0.51, 1200, 2200);
+	wr.tone(0.03, 2190, 2190);
+
+	// calibration: 18 groups of H / M / L.
+	for (int g=0; g<18; g++) {
+		wr.tone(0.04, 1800, 1800);
+		wr.tone(0.04, 1700, 1700);
+		wr.tone(0.04, 1600, 1600);
+	}
+
+	// serial number: 3 bytes + 16 bit sum, LSB first.
+	unsigned char serial[5];
+	serial[0] = cfg.serialNo & 0xff;
+	serial[1] = (cfg.serialNo >> 8) & 0xff;
+	serial[2] = (cfg.serialNo >> 16) & 0xff;
+	int sum = serial[0] + serial[1] + serial[2];
+	serial[3] = sum & 0xff;
+	serial[4] = (sum >> 8) & 0xff;
+	for (int bit=0; bit<40; bit++) {
+		int f = ((serial[bit/8] >> (bit%8)) & 1) ? SerialHighF : SerialLowF;
+		wr.tone(0.08, f, f);
+	}
+
+	// data section.
+	truth << "SerialNo=" << (cfg.serialNo & 0xffffff) << "\n";
+	truth << "SamplingRate=" << cfg.samplingRate << "\n";
+	truth << "DataRate=" << DataRate << "\n";
+	truth << "SNR=" << cfg.snr << "\n";
+	truth << "DropoutRate=" << cfg.dropoutRate << "\n";
+	truth << "DriftPpm=" << cfg.driftPpm << "\n";
+	truth << "[ECG Event1]\n";
+	for (int i=0; i<dataSamples; i++) {
+		double v = ecgValue(i / DataRate, cfg.heartRate);
+		double f = CenterFrequency - v;
+		wr.tone(1.0 / DataRate, f, f);
+		truth << (int)floor(v + 0.5) << "\n";
+	}
+	wr.silence(1.0);
+
+	if (wr.close())
+		return -1;
+	truth.close();
+	std::cout << cfg.wavPath << " : " << wr.getSamples() << " samples, " << dataSamples << " data\n";
+	return 0;
+}
+
+/*
+ [ECG Event1] values and the serial number of an .ecg / truth file.
+ */
+static int readEcgFile(const char *path, std::vector<int> &values, int *serialNo)
+{
+	std::ifstream fs(path);
+	if (fs.fail()) {
+		std::cerr << "Error! cannot open file:" << path << "\n";
+		return -1;
+	}
+	std::string line;
+	bool inData = false;
+	*serialNo = -1;
+	while (std::getline(fs, line)) {
+		if (!line.empty() && line[line.size()-1] == '\r')
+			line.erase(line.size()-1);
+		if (inData) {
+			values.push_back(atoi(line.c_str()));
+			continue;
+		}
+		if (line.compare("[ECG Event1]") == 0)
+			inData = true;
+		else if (line.compare(0, 9, "SerialNo=") == 0)
+			*serialNo = atoi(line.c_str() + 9);
+		else if (line.compare(0, 20, "MonitorSerialNumber=") == 0)
+			*serialNo = atoi(line.c_str() + 20);
+	}
+	return 0;
+}
+
+/*
+ Decode accuracy of ecgPath against truthPath. The decoded data may start
+ a few samples off, the lag with the least error is used.
+ */
+static int compare(const char *truthPath, const char *ecgPath)
+{
+	const int maxLag = 8;
+	std::vector<int> truth, decoded;
+	int truthSerial, decodedSerial;
+
+	if (readEcgFile(truthPath, truth, &truthSerial) || readEcgFile(ecgPath, decoded, &decodedSerial))
+		return -1;
+
+	int bestLag = 0;
+	double bestSq = -1.0;
+	int bestCount = 0;
+	for (int lag=-maxLag; lag<=maxLag; lag++) {
+		double sq = 0.0;
+		int count = 0;
+		for (int i=0; i<(int)decoded.size(); i++) {
+			int k = i + lag;
+			if (k < 0 || k >= (int)truth.size())
+				continue;
+			double d = decoded[i] - truth[k];
+			sq += d*d;
+			count++;
+		}
+		if (count > 0 && (bestSq < 0.0 || sq/count < bestSq/bestCount)) {
+			bestSq = sq;
+			bestCount = count;
+			bestLag = lag;
+		}
+	}
+
+	double bias = 0.0;
+	int maxAbs = 0;
+	int within10 = 0;
+	for (int i=0; i<(int)decoded.size(); i++) {
+		int k = i + bestLag;
+		if (k < 0 || k >= (int)truth.size())
+			continue;
+		int d = decoded[i] - truth[k];
+		bias += d;
+		if (abs(d) > maxAbs) maxAbs = abs(d);
+		if (abs(d) <= 10) within10++;
+	}
+
+	std::cout << "{\n";
+	std::cout << "  \"serialNo\": " << decodedSerial << ",\n";
+	std::cout << "  \"serialMatch\": " << ((decodedSerial == truthSerial) ? "true" : "false") << ",\n";
+	std::cout << "  \"truthSamples\": " << truth.size() << ",\n";
+	std::cout << "  \"decodedSamples\": " << decoded.size() << ",\n";
+	std::cout << "  \"comparedSamples\": " << bestCount << ",\n";
+	std::cout << "  \"lag\": " << bestLag << ",\n";
+	std::cout << "  \"bias\": " << ((bestCount > 0) ? bias / bestCount : 0.0) << ",\n";
+	std::cout << "  \"rms\": " << ((bestCount > 0) ? sqrt(bestSq / bestCount) : 0.0) << ",\n";
+	std::cout << "  \"maxAbs\": " << maxAbs << ",\n";
+	std::cout << "  \"within10\": " << ((bestCount > 0) ? (double)within10 / bestCount : 0.0) << "\n";
+	std::cout << "}\n";
+	return 0;
+}
+
+static void usage(void)
+{
+	std::cerr << "usage  ECGSynth.exe out.wav [options]\n";
+	std::cerr << "\t-r samplingRate (48000)\n";
+	std::cerr << "\t-s serialNo (10018)\n";
+	std::cerr << "\t-d dataTime (sec, 10)\n";
+	std::cerr << "\t-h heartRate (bpm, 72)\n";
+	std::cerr << "\t-n snr (dB, no noise)\n";
+	std::cerr << "\t-x dropouts (per minute)\n";
+	std::cerr << "\t-y dropoutTime (msec, 50)\n";
+	std::cerr << "\t-c clockDrift (ppm)\n";
+	std::cerr << "\t-l leadInTime (sec, 0.5)\n";
+	std::cerr << "\t-e seed (1)\n";
+	std::cerr << "\t-t truthFile (out.txt)\n";
+	std::cerr << "       ECGSynth.exe -a truthFile ecgFile (accuracy as JSON)\n";
+}
+
+int _tmain(int argc, _TCHAR* argv[])
+{
+	char cstr[_MAX_PATH];
+	char cstr2[_MAX_PATH];
+	size_t len;
+	synthConfig cfg;
+
+	cfg.samplingRate = 48000;
+	cfg.serialNo = 10018;
+	cfg.dataTime = 10.0;
+	cfg.heartRate = 72.0;
+	cfg.snr = -1.0;
+	cfg.dropoutRate = 0.0;
+	cfg.dropoutTime = 0.05;
+	cfg.driftPpm = 0.0;
+	cfg.leadInTime = 0.5;
+	cfg.seed = 1;
+
+	for (int idx=1; idx<argc; idx++) {
+		wcstombs_s(&len, cstr, sizeof(cstr), argv[idx], _TRUNCATE);
+		if (cstr[0] != '-') {
+			if (!cfg.wavPath.empty()) {
+				usage();
+				return -1;
+			}
+			cfg.wavPath = std::string(cstr);
+			continue;
+		}
+		char opt = cstr[1];
+		if (idx+1 >= argc) {
+			usage();
+			return -1;
+		}
+		wcstombs_s(&len, cstr, sizeof(cstr), argv[++idx], _TRUNCATE);
+		switch (opt) {
+		case 'a':
+			if (idx+1 >= argc) {
+				usage();
+				return -1;
+			}
+			wcstombs_s(&len, cstr2, sizeof(cstr2), argv[++idx], _TRUNCATE);
+			return compare(cstr, cstr2);
+		case 'r':	cfg.samplingRate = atoi(cstr);				break;
+		case 's':	cfg.serialNo = atoi(cstr);					break;
+		case 'd':	cfg.dataTime = atof(cstr);					break;
+		case 'h':	cfg.heartRate = atof(cstr);					break;
+		case 'n':	cfg.snr = atof(cstr);						break;
+		case 'x':	cfg.dropoutRate = atof(cstr);				break;
+		case 'y':	cfg.dropoutTime = atof(cstr) / 1000.0;		break;
+		case 'c':	cfg.driftPpm = atof(cstr);					break;
+		case 'l':	cfg.leadInTime = atof(cstr);				break;
+		case 'e':	cfg.seed = (unsigned int)atoi(cstr);		break;
+		case 't':	cfg.truthPath = std::string(cstr);			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (cfg.wavPath.empty() || cfg.samplingRate < 8000 || cfg.dataTime <= 0.0 || cfg.heartRate <= 0.0) {
+		usage();
+		return -1;
+	}
+	if (cfg.truthPath.empty()) {
+		size_t pidx = cfg.wavPath.find_last_of('.');
+		cfg.truthPath = std::string(cfg.wavPath, 0, pidx) + ".txt";
+	}
+	return synthesize(cfg) ? -1 : 0;
+}
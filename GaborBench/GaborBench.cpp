@@ -0,0 +1,321 @@
+// GaborBench.cpp : microbenchmark of gabor_transform / fvconvert / fast_fcnv.
+//
+// Drives the Convert2ECG frequency search with synthetic tones for the
+// parameter sets of the call sites, on the 44.1 and 48 kHz tables, and
+// prints the latency per call as JSON.
+//
+// usage: GaborBench.exe [-n calls] [-k scalar|sse2|avx2|avx512] [-o file.json]
+//
+
+#include "stdafx.h"
+#include "Convert2ECG.h"
+#include "GaborTableSet.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+static const int kSegments = 64;				// tone steps in the test signal.
+static const double kSegmentTime = 0.02;		// sec per tone step.
+static const double kMarginTime = 0.1;			// sec of tone before / after the steps.
+static const int kWarmupCalls = 64;
+
+// call-site parameter sets: (minF, maxF, pitch)
+struct benchCase {
+	int		minF;
+	int		maxF;
+	int		pitch;
+	const char *site;
+};
+static const benchCase benchCases[] = {
+	{ 1000, 2280,  1, "data section" },
+	{ 1500, 1900,  5, "calibration" },
+	{ 1200, 2200, 20, "serial number" },
+	{ 1180, 1320, 10, "header lead-in" },
+};
+static const int benchCaseCount = sizeof(benchCases)/sizeof(benchCases[0]);
+static const int benchRates[] = { SamplingRate441, SamplingRate480 };
+static const int benchRateCount = sizeof(benchRates)/sizeof(benchRates[0]);
+
+enum {
+	FuncGaborTransform,
+	FuncFvconvert,
+	FuncFastFcnv,
+};
+static const char *funcNames[] = { "gabor_transform", "fvconvert", "fast_fcnv" };
+
+/*
+ Monotonic clock in nano seconds. QueryPerformanceCounter on Windows
+ (steady_clock of VS2012 has only the system timer resolution).
+ */
+static double nowNanoSec(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart * 1.0e9 / (double)freq.QuadPart;
+#else
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+class GaborBench
+{
+private:
+	GaborTableSet tables;
+	Convert2ECG *conv;
+	std::vector<float> pcm;
+	std::vector<int> toneF;					// [kSegments] tone of each step.
+	int		segmentLen;
+	int		marginLen;
+
+	struct result {
+		int		rate;
+		int		func;
+		const benchCase *bc;
+		int		calls;
+		double	meanNs;
+		double	p50Ns;
+		double	p90Ns;
+		double	p99Ns;
+		double	maxNs;
+		double	meanErrHz;					// < 0: not an estimate.
+		int		misses;						// no peak found.
+	};
+	std::vector<result> results;
+
+	void makeSignal(int rate, const benchCase &bc);
+	void runCase(int rate, int func, const benchCase &bc, int calls);
+
+public:
+	GaborBench(void) { conv = nullptr; segmentLen = marginLen = 0; }
+	virtual ~GaborBench(void) { delete conv; }
+
+	int setup(std::string exePath, int maxLevel);
+	int run(int calls);
+	void outJson(std::ostream &os, int calls);
+};
+
+int GaborBench::setup(std::string exePath, int maxLevel)
+{
+	conv = new Convert2ECG();
+	conv->shareTables(&tables);
+	tables.init(exePath, false, false);
+	for (int r=0; r<benchRateCount; r++) {
+		float level;
+		GaborKernel *kernel = tables.get(benchRates[r], &level);
+		if (!kernel) {
+			std::cerr << "Error! cannot load G-Table (" << benchRates[r] << "Hz)\n";
+			return -1;
+		}
+		kernel->select(maxLevel);
+	}
+	return 0;
+}
+
+/*
+ Phase continuous tone steps over minF .. maxF, amplitude 0.5.
+ */
+void GaborBench::makeSignal(int rate, const benchCase &bc)
+{
+	segmentLen = (int)(kSegmentTime * rate);
+	marginLen = (int)(kMarginTime * rate);
+	toneF.resize(kSegments);
+	pcm.resize(marginLen*2 + segmentLen*kSegments);
+
+	unsigned int seed = 12345;
+	for (int s=0; s<kSegments; s++) {
+		seed = seed * 1103515245 + 12345;
+		toneF[s] = bc.minF + (int)((seed >> 8) % (unsigned int)(bc.maxF - bc.minF));
+	}
+	double phase = 0.0;
+	for (int i=0; i<(int)pcm.size(); i++) {
+		int s = (i - marginLen) / segmentLen;
+		if (s < 0) s = 0;
+		if (s >= kSegments) s = kSegments-1;
+		pcm[i] = (float)(0.5 * sin(phase));
+		phase += 2.0*M_PI*toneF[s]/rate;
+		if (phase > 2.0*M_PI)
+			phase -= 2.0*M_PI;
+	}
+}
+
+void GaborBench::runCase(int rate, int func, const benchCase &bc, int calls)
+{
+	float wt[2048];
+	int wt_len = (bc.maxF - bc.minF) / bc.pitch;
+	std::vector<double> lap(calls);
+	double errSum = 0.0;
+	int misses = 0;
+
+	for (int i=-kWarmupCalls; i<calls; i++) {
+		// center of a tone step, moved a little per call.
+		int s = ((i < 0) ? -i : i) % kSegments;
+		float *p = &pcm[marginLen + s*segmentLen + segmentLen/2 + (i*7) % (segmentLen/4)];
+		int f = 0;
+
+		double t0 = nowNanoSec();
+		switch (func) {
+		case FuncGaborTransform:	conv->gabor_transform(p, bc.minF, bc.pitch, wt, wt_len);	break;
+		case FuncFvconvert:			f = conv->fvconvert(p, bc.minF, bc.maxF, bc.pitch);		break;
+		case FuncFastFcnv:			f = conv->fast_fcnv(p, bc.minF, bc.maxF, bc.pitch);		break;
+		}
+		double t1 = nowNanoSec();
+		if (i < 0)
+			continue;
+		lap[i] = t1 - t0;
+		if (func != FuncGaborTransform) {
+			if (f < 0)
+				misses++;
+			else
+				errSum += abs(f - toneF[s]);
+		}
+	}
+
+	result r;
+	r.rate = rate;
+	r.func = func;
+	r.bc = &bc;
+	r.calls = calls;
+	double sum = 0.0;
+	for (int i=0; i<calls; i++)
+		sum += lap[i];
+	std::sort(lap.begin(), lap.end());
+	r.meanNs = sum / calls;
+	r.p50Ns = lap[calls/2];
+	r.p90Ns = lap[(int)(calls*0.90)];
+	r.p99Ns = lap[(int)(calls*0.99)];
+	r.maxNs = lap[calls-1];
+	r.meanErrHz = (func == FuncGaborTransform) ? -1.0 : (calls > misses) ? errSum / (calls - misses) : 0.0;
+	r.misses = misses;
+	results.push_back(r);
+}
+
+int GaborBench::run(int calls)
+{
+	for (int r=0; r<benchRateCount; r++) {
+		int rate = benchRates[r];
+		conv->samplingRateI = rate;
+		conv->samplingRateF = (float)rate;
+		if (conv->setupGTable(rate, ""))
+			return -1;
+		for (int c=0; c<benchCaseCount; c++) {
+			makeSignal(rate, benchCases[c]);
+			for (int func=FuncGaborTransform; func<=FuncFastFcnv; func++)
+				runCase(rate, func, benchCases[c], calls);
+		}
+	}
+	return 0;
+}
+
+void GaborBench::outJson(std::ostream &os, int calls)
+{
+	os << "{\n";
+	os << "  \"kernel\": \"" << conv->gkernel->getLevelName() << "\",\n";
+	os << "  \"calls\": " << calls << ",\n";
+	os << "  \"results\": [\n";
+	for (size_t i=0; i<results.size(); i++) {
+		const result &r = results[i];
+		os << "    { \"rate\": " << r.rate
+		   << ", \"function\": \"" << funcNames[r.func] << "\""
+		   << ", \"site\": \"" << r.bc->site << "\""
+		   << ", \"minF\": " << r.bc->minF
+		   << ", \"maxF\": " << r.bc->maxF
+		   << ", \"pitch\": " << r.bc->pitch
+		   << ", \"nsPerCall\": " << (long long)(r.meanNs + 0.5)
+		   << ", \"estimatesPerSec\": " << (long long)(1.0e9 / r.meanNs + 0.5)
+		   << ", \"p50Ns\": " << (long long)(r.p50Ns + 0.5)
+		   << ", \"p90Ns\": " << (long long)(r.p90Ns + 0.5)
+		   << ", \"p99Ns\": " << (long long)(r.p99Ns + 0.5)
+		   << ", \"maxNs\": " << (long long)(r.maxNs + 0.5);
+		if (r.meanErrHz >= 0.0)
+			os << ", \"meanErrorHz\": " << r.meanErrHz << ", \"misses\": " << r.misses;
+		os << " }" << ((i+1 < results.size()) ? "," : "") << "\n";
+	}
+	os << "  ]\n";
+	os << "}\n";
+}
+
+static void usage(void)
+{
+	std::cerr << "usage  GaborBench.exe [-n calls] [-k scalar|sse2|avx2|avx512] [-o file.json]\n";
+}
+
+int _tmain(int argc, _TCHAR* argv[])
+{
+	int calls = 2000;
+	int maxLevel = GaborKernel::KernelAVX512;
+	std::string outPath;
+	char cstr[_MAX_PATH];
+	size_t len;
+
+	wcstombs_s(&len, cstr, sizeof(cstr), argv[0], _TRUNCATE);
+	std::string exePath = std::string(cstr);
+	exePath = std::string(exePath, 0, exePath.find_last_of('\\') + 1);
+
+	for (int idx=1; idx<argc; idx++) {
+		wcstombs_s(&len, cstr, sizeof(cstr), argv[idx], _TRUNCATE);
+		if (cstr[0] != '-' || idx+1 >= argc) {
+			usage();
+			return -1;
+		}
+		char opt = cstr[1];
+		wcstombs_s(&len, cstr, sizeof(cstr), argv[++idx], _TRUNCATE);
+		switch (opt) {
+		case 'n':
+			calls = atoi(cstr);
+			break;
+		case 'k':
+			if (strcmp(cstr, "scalar") == 0)		maxLevel = GaborKernel::KernelScalar;
+			else if (strcmp(cstr, "sse2") == 0)		maxLevel = GaborKernel::KernelSSE2;
+			else if (strcmp(cstr, "avx2") == 0)		maxLevel = GaborKernel::KernelAVX2;
+			else if (strcmp(cstr, "avx512") == 0)	maxLevel = GaborKernel::KernelAVX512;
+			else {
+				usage();
+				return -1;
+			}
+			break;
+		case 'o':
+			outPath = std::string(cstr);
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+	if (calls < 100) {
+		std::cerr << "Error! calls must be 100 or more.\n";
+		return -1;
+	}
+
+	GaborBench bench;
+	if (bench.setup(exePath, maxLevel) || bench.run(calls))
+		return -1;
+
+	if (outPath.empty()) {
+		bench.outJson(std::cout, calls);
+	}
+	else {
+		std::ofstream fs(outPath.c_str());
+		if (fs.fail()) {
+			std::cerr << "Error! cannot create output file:" << outPath << "\n";
+			return -1;
+		}
+		bench.outJson(fs, calls);
+	}
+	return 0;
+}
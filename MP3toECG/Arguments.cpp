@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "Arguments.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <Windows.h>
@@ -12,8 +13,20 @@ Arguments::Arguments(void)
 	opt_w = false;
 	opt_r = false;
 	opt_X = false;
+	opt_f = false;
+	opt_b = false;
+	opt_p = false;
+	opt_J = false;
+	opt_D = false;
+	opt_B = false;
+	opt_S = false;
+	opt_T = false;
+	jobs = 0;
+	threads = 0;
+	engine = ENGINE_GABOR;
 	owSerialNo = 0;
 	donlyStartTime = 0.0;
+	cacheSizeMB = 256;
 	memset(pathInput, 0, sizeof(pathInput));
 	memset(pathOutput, 0, sizeof(pathOutput));
 }
@@ -80,6 +93,47 @@ int Arguments::parseArgs(int argc, _TCHAR* argv[])
 			case 'X':
 				opt_X = true;			// debug.
 				break;
+			case 'f':
+				opt_f = true;			// decode MP3 by ffmpeg.
+				break;
+			case 'b':
+				opt_b = true;			// batch mode.
+				break;
+			case 'J':
+				opt_J = true;			// stage report JSON.
+				break;
+			case 'D':
+				opt_D = true;			// decimate the PCM.
+				break;
+			case 'B':
+				opt_B = true;			// binary ECG output.
+				break;
+			case 'S':
+				opt_S = true;			// server mode.
+				break;
+			case 'T':
+				opt_T = true;			// track the data frequency.
+				break;
+			case 't':					// data section threads.
+				idx++;
+				if (idx >= argc)
+					return -1;
+				threads = _tstoi(argv[idx]);
+				break;
+			case 'p':
+				opt_p = true;			// stream WAV input.
+				break;
+			case '\0':					// "-": stdin
+				if (mp3Fname.length() > 0)
+					return -1;
+				mp3Fname = std::string(cstr);
+				break;
+			case 'j':					// batch worker threads.
+				idx++;
+				if (idx >= argc)
+					return -1;
+				jobs = _tstoi(argv[idx]);
+				break;
 			case 'o':
 				idx++;
 				if (idx >= argc)
@@ -99,6 +153,24 @@ int Arguments::parseArgs(int argc, _TCHAR* argv[])
 					return -1;
 				donlyStartTime = _tstof(argv[idx]);
 				break;
+			case 'e':					// frequency engine.
+				idx++;
+				if (idx >= argc)
+					return -1;
+				toStdString(argv[idx], cstr, sizeof(cstr));
+				if (strcmp(cstr, "gabor") == 0)
+					engine = ENGINE_GABOR;
+				else if (strcmp(cstr, "sliding") == 0)
+					engine = ENGINE_SLIDING;
+				else if (strcmp(cstr, "demod") == 0)
+					engine = ENGINE_DEMOD;
+				else if (strcmp(cstr, "int16") == 0)
+					engine = ENGINE_FIXED;
+				else {
+					std::cerr << "Error! unknown engine:" << cstr << "\n";
+					return -1;
+				}
+				break;
 			}
 		}
 		else {
@@ -114,20 +186,79 @@ int Arguments::parseArgs(int argc, _TCHAR* argv[])
 		std::cerr << "Error! Not found input file(mp3).\n";
 		return -1;					// not found input file.
 	}
+
+	if (opt_p) {
+		// input is a WAV stream. ("-": stdin)
+		if (opt_b) {
+			std::cerr << "Error! -p cannot be used in batch mode.\n";
+			return -1;
+		}
+		if (mp3Fname.compare("-") == 0 && ecgFname.empty())
+			ecgFname = std::string("stdin") + EXT_ECGFILE;
+	}
+
+	if (opt_S) {
+		// input is the pipe name. (see getPipeName)
+		if (opt_b || opt_p || !ecgFname.empty()) {
+			std::cerr << "Error! -b, -p and -o cannot be used in server mode.\n";
+			return -1;
+		}
+		return 0;
+	}
+
+	if (opt_b) {
+		// input is a folder, wildcard or list file. (see listInputFiles)
+		if (!ecgFname.empty()) {
+			std::cerr << "Error! -o cannot be used in batch mode.\n";
+			return -1;
+		}
+		if ( opt_v ) {
+			std::cout << "Convert Mp3 --> ECG. batch...\n";
+			std::cout << "\tEXE Path:    " << currentPath<< "\n";
+			std::cout << "\tECG Path:    " << pathECGBase << "\n";
+			std::cout << "\tInput:       " << mp3Fname << "\n";
+		}
+		return 0;
+	}
+
+	setInputFile(mp3Fname);
+
+	if ( opt_v ) {
+		std::cout << "Convert Mp3 --> ECG. arguments...\n";
+		std::cout << "\tEXE Path:    " << currentPath<< "\n";
+		std::cout << "\tECG Path:    " << pathECGBase << "\n";
+		std::cout << "\tInput  Mp3 File: " << mp3Fname << "\n";
+		std::cout << "\tWork   Wav File: " << wavFname << "\n";
+		std::cout << "\tOutput Ecg File: " << ecgFname << "\n";
+		std::cout << "\tOut Status File: " << statusFname << "\n";	}
+
+	return 0;
+}
+
+/*
+ Set the input MP3 file and the names of the work / output files.
+ */
+int Arguments::setInputFile(std::string fname)
+{
+	mp3Fname = fname;
+
 	int npos = mp3Fname.find(EXT_MP3FILE, sizeof(EXT_MP3FILE));
 	int nlen = mp3Fname.length() - (sizeof(EXT_MP3FILE) -1);
-	if (npos != nlen)
+	if (npos != nlen && !opt_p && !isWaveInput())
 		mp3Fname.append(EXT_MP3FILE);
 	
-	// set intpu WAV file.
+	// set intpu WAV file. (name.pid.tid.wav: batch workers and server
+	// sessions may convert the same file name of two folders at a time)
 	if (wavFname.empty()) {
 		int dpos = mp3Fname.rfind('\\');
 		wavFname = mp3Fname.substr(dpos + 1);
 		int pposi = wavFname.find_last_of('.');
 		if (pposi > 0)
-			wavFname.replace(pposi, sizeof(EXT_WAVFILE), EXT_WAVFILE);
-		else
-			wavFname.append(EXT_WAVFILE);
+			wavFname.erase(pposi);
+		char unique[32];
+		sprintf_s(unique, sizeof(unique), ".%lu.%lu", (unsigned long)GetCurrentProcessId(), (unsigned long)GetCurrentThreadId());
+		wavFname.append(unique);
+		wavFname.append(EXT_WAVFILE);
 	}
 
 	// set output file.
@@ -149,18 +280,141 @@ int Arguments::parseArgs(int argc, _TCHAR* argv[])
 	else
 		statusFname.append(EXT_STATUSFILE);
 
-	if ( opt_v ) {
-		std::cout << "Convert Mp3 --> ECG. arguments...\n";
-		std::cout << "\tEXE Path:    " << currentPath<< "\n";
-		std::cout << "\tECG Path:    " << pathECGBase << "\n";
-		std::cout << "\tInput  Mp3 File: " << mp3Fname << "\n";
-		std::cout << "\tWork   Wav File: " << wavFname << "\n";
-		std::cout << "\tOutput Ecg File: " << ecgFname << "\n";
-		std::cout << "\tOut Status File: " << statusFname << "\n";	}
+	// set report file.
+	reportFname = ecgFname.substr(0);
+	if (pposi_stat > 0)
+		reportFname.replace(pposi_stat, sizeof(EXT_REPORTFILE), EXT_REPORTFILE);
+	else
+		reportFname.append(EXT_REPORTFILE);
+
+	// set binary ECG file.
+	binaryFname = ecgFname.substr(0);
+	if (pposi_stat > 0)
+		binaryFname.replace(pposi_stat, sizeof(EXT_BINARYFILE), EXT_BINARYFILE);
+	else
+		binaryFname.append(EXT_BINARYFILE);
 
 	return 0;
 }
 
+/*
+ Options and input of a server job: [-c] [-r] [-w] [-s serialNo] [-d startTime] file
+ */
+int Arguments::parseJobArgs(std::vector<std::string> &args)
+{
+	std::string fname;
+
+	for (size_t idx=0; idx<args.size(); idx++) {
+		const std::string &arg = args[idx];
+		if (arg.length() == 2 && arg.at(0) == '-') {
+			switch (arg.at(1)) {
+			case 'c':
+				opt_c = true;			// through Calibration
+				break;
+			case 'r':
+				opt_r = true;			// convert to Raw data.
+				break;
+			case 'w':
+				opt_w = true;			// convert Whole data.
+				break;
+			case 's':					// over write Serial NO.
+				if (++idx >= args.size())
+					return -1;
+				owSerialNo = atoi(args[idx].c_str());
+				break;
+			case 'd':					// onvert only Data section. (sec)
+				if (++idx >= args.size())
+					return -1;
+				donlyStartTime = atof(args[idx].c_str());
+				break;
+			default:
+				return -1;
+			}
+		}
+		else {
+			if (!fname.empty())
+				return -1;				// dupricated input file.
+			fname = arg;
+		}
+	}
+	if (fname.empty())
+		return -1;
+
+	setInputFile(fname);
+	return 0;
+}
+
+/*
+ The input is a WAV file: read directly, not decoded. (not -p)
+ */
+bool Arguments::isWaveInput(void)
+{
+	size_t len = sizeof(EXT_WAVFILE) -1;
+	if (opt_p || mp3Fname.length() <= len)
+		return false;
+	return _stricmp(mp3Fname.c_str() + mp3Fname.length() - len, EXT_WAVFILE) == 0;
+}
+
+/*
+ Pipe of the server mode. a bare name is put under \\.\pipe\
+ */
+std::string Arguments::getPipeName(void)
+{
+	if (mp3Fname.compare(0, 2, "\\\\") == 0)
+		return mp3Fname;
+	return std::string("\\\\.\\pipe\\") + mp3Fname;
+}
+
+/*
+ Input files of the batch mode.
+   folder (D:\mp3\)     : all *.mp3 in the folder.
+   wildcard (D:\mp3\*.mp3): matching files.
+   other                : list file, one mp3 path per line. ('#': comment)
+ */
+int Arguments::listInputFiles(std::vector<std::string> &files)
+{
+	std::string pattern = mp3Fname;
+	DWORD attr = GetFileAttributesA(pattern.c_str());
+
+	if (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY)) {
+		if (pattern.at(pattern.length()-1) != '\\')
+			pattern.append("\\");
+		pattern.append("*");
+		pattern.append(EXT_MP3FILE);
+	}
+
+	if (pattern.find_first_of("*?") != std::string::npos) {
+		std::string folder = pattern.substr(0, pattern.rfind('\\') + 1);
+		WIN32_FIND_DATAA fd;
+		HANDLE hFind = FindFirstFileA(pattern.c_str(), &fd);
+		if (hFind != INVALID_HANDLE_VALUE) {
+			do {
+				if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+					files.push_back(folder + fd.cFileName);
+			} while (FindNextFileA(hFind, &fd));
+			FindClose(hFind);
+		}
+	}
+	else {
+		std::ifstream lst;
+		std::string line;
+		lst.open(pattern.c_str());
+		if (lst.fail()) {
+			std::cerr << "Error! cannot open list file:" << pattern << "\n";
+			return -1;
+		}
+		while (std::getline(lst, line)) {
+			size_t end = line.find_last_not_of(" \t\r");
+			if (end == std::string::npos || line.at(0) == '#')
+				continue;
+			files.push_back(line.substr(0, end + 1));
+		}
+	}
+
+	std::sort(files.begin(), files.end());
+	return 0;
+}
+
 int Arguments::parseConfigf(void)
 {
 	std::string configPath = std::string(currentPath);
@@ -186,6 +440,14 @@ int Arguments::parseConfigf(void)
 			if (pathECGBase.at(pathECGBase.length()-1) != '\\')
 				pathECGBase.append( "\\" );
 		}
+		if (str.compare("CACHEFOLDER") == 0) {	// Ex. D:\ECG_Cache
+			cfst >> cacheFolder;
+			if (cacheFolder.at(cacheFolder.length()-1) != '\\')
+				cacheFolder.append( "\\" );
+		}
+		if (str.compare("CACHESIZE") == 0) {	// MByte
+			cfst >> cacheSizeMB;
+		}
 #if 0
 		if (str.compare("OUTFOLDER") == 0) {
 			cfst >> outFolderName;
@@ -230,6 +492,22 @@ int Arguments::getStatusPath(char *fpath, size_t len)
 	return 0;
 }
 
+int Arguments::getReportPath(char *fpath, size_t len)
+{
+	std::string path(pathECGBase.c_str(), pathECGBase.length());
+	path.append(reportFname);
+	strcpy_s(fpath, len, path.c_str());
+	return 0;
+}
+
+int Arguments::getBinaryPath(char *fpath, size_t len)
+{
+	std::string path(pathECGBase.c_str(), pathECGBase.length());
+	path.append(binaryFname);
+	strcpy_s(fpath, len, path.c_str());
+	return 0;
+}
+
 int Arguments::convertToWave(void)
 {
 	static std::string CmdName_ffmpeg = "ffmpeg";
@@ -241,7 +519,7 @@ int Arguments::convertToWave(void)
 	cmd_ffmpeg.append(" -i ");
 	getMp3FilePath(path, sizeof(path));
 	cmd_ffmpeg.append(path);
-	cmd_ffmpeg.append(" -ac 1 -ar 48000 -y ");
+	cmd_ffmpeg.append(" -y ");			// all channels. (Convert2ECG::selectChannel)
 	getWavFilePath(path, sizeof(path));
 	cmd_ffmpeg.append(path);
 
@@ -254,6 +532,8 @@ int Arguments::convertToWave(void)
 int Arguments::delteWaveFile(void)
 {
 	char path[_MAX_PATH];
+	if (isWaveInput())
+		return 0;						// no work file, never the input.
 	getWavFilePath(path, sizeof(path));
 	remove(path);
 
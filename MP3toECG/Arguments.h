@@ -1,11 +1,20 @@
 #pragma once
 #include <stdlib.h>
 #include <string>
+#include <vector>
 
 #define EXT_MP3FILE ".mp3"
 #define EXT_WAVFILE ".wav"
 #define EXT_ECGFILE ".ecg"
 #define EXT_STATUSFILE ".rst"
+#define EXT_REPORTFILE ".json"
+#define EXT_BINARYFILE ".ecb"
+
+// frequency engine of the data section. (-e option)
+#define ENGINE_GABOR		0
+#define ENGINE_SLIDING		1
+#define ENGINE_DEMOD		2
+#define ENGINE_FIXED		3			// Gabor transform, 16 bit kernel.
 
 const std::string ConfigFilePath = "MP3toECG.cfg";
 
@@ -17,6 +26,8 @@ private:
 	std::string wavFname;
 	std::string ecgFname;
 	std::string statusFname;
+	std::string reportFname;
+	std::string binaryFname;
 
 	char ecgFPath[_MAX_PATH];			// default folder path.
 	char ecgOutFolder[_MAX_PATH];		// out folder name.
@@ -29,9 +40,22 @@ public:
 	bool opt_w;							// convert Whole data.
 	bool opt_r;							// convert to Raw data.
 	bool opt_X;							// debug..
+	bool opt_f;							// decode MP3 by ffmpeg.
+	bool opt_b;							// batch mode.
+	bool opt_p;							// stream WAV input. (stdin / pipe)
+	bool opt_J;							// stage report JSON.
+	bool opt_D;							// decimate the PCM.
+	bool opt_B;							// binary ECG output.
+	bool opt_S;							// server mode. (named pipe)
+	bool opt_T;							// track the data frequency.
+	int		jobs;						// batch worker threads. (0: CPU count)
+	int		threads;					// data section threads. (0: CPU count)
+	int		engine;						// frequency engine (ENGINE_xxx)
 	int		owSerialNo;
 	double	donlyStartTime;
 	std::string currentPath;
+	std::string cacheFolder;			// result cache. (empty: not used)
+	int		cacheSizeMB;				// result cache limit.
 
 	Arguments(void);
 
@@ -39,9 +63,16 @@ public:
 	int convertToWave(void);
 	int delteWaveFile(void);
 	int parseArgs(int argc, _TCHAR* argv[]);
+	int setInputFile(std::string fname);
+	bool isWaveInput(void);
+	int listInputFiles(std::vector<std::string> &files);
+	int parseJobArgs(std::vector<std::string> &args);
+	std::string getPipeName(void);
 	int parseConfigf(void);
 	int getMp3FilePath(char *, size_t len);
 	int getWavFilePath(char *, size_t len);
 	int getEcgFilePath(char *, size_t len);
 	int getStatusPath(char *, size_t len);
+	int getReportPath(char *, size_t len);
+	int getBinaryPath(char *, size_t len);
 };
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include "stdafx.h"
+#include "BatchConverter.h"
+#include "Convert2ECG.h"
+#include "ErrorStatusNo.h"
+#include "ResultCache.h"
+
+#include <iostream>
+#include <locale.h>
+#include <thread>
+
+BatchConverter::BatchConverter(void)
+{
+	nextFile = 0;
+	failedFiles = 0;
+}
+
+BatchConverter::~BatchConverter(void)
+{
+}
+
+/*
+ Same steps as _tmain for one file.
+ */
+int BatchConverter::convertFile(const std::string &mp3Path, ECGBuffer &ecg)
+{
+	Arguments argument = baseArg;
+	argument.setInputFile(mp3Path);
+	if (argument.threads == 0)
+		argument.threads = 1;				// the files are already in parallel.
+
+	ResultCache cache;
+	if (cache.open(argument) == 0) {
+		int status, serialNo;
+		if (cache.fetch(argument, &status, &serialNo) == 0)
+			return status;
+	}
+
+	Convert2ECG converter;
+	converter.shareTables(&tables);
+	converter.shareECGBuffer(&ecg);
+
+	int status = -1;
+	if (argument.isWaveInput())
+		status = ERR_OK;						// read in place by convert.
+	else if (!argument.opt_f)
+		status = converter.decodeMp3(argument);
+	if (status != ERR_OK) {
+		converter.startStage(StageTimer::StageFfmpeg);
+		status = argument.convertToWave();		// use ffmpeg.
+		converter.stopStage(StageTimer::StageFfmpeg);
+		if (status != ERR_OK) {
+			std::lock_guard<std::mutex> guard(outLock);
+			std::cerr << "Error Internal cannot convert MP3 to WAV:" << mp3Path << "\n";
+			return -1;
+		}
+	}
+
+	status = converter.convert(argument);
+	converter.outStatus(argument, status);
+	cache.store(argument, status, converter.getSerialNo());
+
+	argument.delteWaveFile();
+	return status;
+}
+
+void BatchConverter::worker(void)
+{
+#ifdef _MSC_VER
+	// outStatus / outECG call setlocale().
+	_configthreadlocale(_ENABLE_PER_THREAD_LOCALE);
+#endif
+	ECGBuffer ecg;							// grown once, kept for the next files.
+	for (;;) {
+		int idx = nextFile++;
+		if (idx >= (int)files.size())
+			break;
+
+		int status = convertFile(files[idx], ecg);
+		if (status != ERR_OK)
+			failedFiles++;
+
+		std::lock_guard<std::mutex> guard(outLock);
+		std::cout << files[idx] << "\tstatus:" << status << "\n";
+	}
+}
+
+/*
+ Convert all input files. returns the number of files not converted.
+ */
+int BatchConverter::run(Arguments &arg)
+{
+	baseArg = arg;
+	if (baseArg.listInputFiles(files))
+		return -1;
+	if (files.empty()) {
+		std::cerr << "Error! Not found input file(mp3).\n";
+		return -1;
+	}
+	tables.init(baseArg.currentPath, baseArg.opt_v, baseArg.opt_X);
+
+	int jobs = baseArg.jobs;
+	if (jobs <= 0)
+		jobs = (int)std::thread::hardware_concurrency();
+	if (jobs <= 0)
+		jobs = 1;
+	if (jobs > (int)files.size())
+		jobs = (int)files.size();
+	if (baseArg.opt_v) {
+		std::cout << "Batch: " << files.size() << " files, " << jobs << " workers\n";
+	}
+
+	std::vector<std::thread> workers;
+	for (int i=1; i<jobs; i++)
+		workers.push_back(std::thread(&BatchConverter::worker, this));
+	worker();
+	for (size_t i=0; i<workers.size(); i++)
+		workers[i].join();
+
+	if (baseArg.opt_v) {
+		std::cerr << "\n\tbatch: " << files.size() - failedFiles << "/" << files.size() << " converted\n";
+	}
+	return failedFiles;
+}
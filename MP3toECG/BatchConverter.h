@@ -0,0 +1,35 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Arguments.h"
+#include "ECGBuffer.h"
+#include "GaborTableSet.h"
+
+/*
+ Batch mode. (-b)
+
+ Many MP3 files are converted by a pool of worker threads in one process.
+ The configuration is parsed once and the G-Tables are shared read-only by
+ all workers, each file gets its own .ecg / .rst as in the single mode.
+ */
+class BatchConverter
+{
+private:
+	Arguments	baseArg;
+	GaborTableSet tables;
+	std::vector<std::string> files;
+	std::atomic<int> nextFile;
+	std::atomic<int> failedFiles;
+	std::mutex	outLock;
+
+	int convertFile(const std::string &mp3Path, ECGBuffer &ecg);
+	void worker(void);
+
+public:
+	BatchConverter(void);
+	virtual ~BatchConverter(void);
+
+	int run(Arguments &arg);
+};
@@ -1,183 +1,462 @@
 #include "stdafx.h"
 #include "Convert2ECG.h"
 #include "ErrorStatusNo.h"
+#include "Mp3Decoder.h"
+#include "PcmStream.h"
+#include "WavFile.h"
 
 #include <fstream>
 #include <iostream>
 #include <locale.h>
+#include <thread>
+#include <vector>
 
 Convert2ECG::Convert2ECG(void)
 {
-	gtbl = nullptr;
+	tables = &ownTables;
+	gkernel = nullptr;
 	pcmdata = nullptr;
+	for (int c=0; c<MaxChannels; c++)
+		channelData[c] = nullptr;
+	channels = 1;
+	selectedChannel = 0;
+	pcm16 = nullptr;
+	gkernel16 = nullptr;
+	fixedKernel = false;
+	memoActive = false;
+	stream = nullptr;
+	streamError = false;
+	pcmLength = 0;
+	durationPCMTime = 0.0;
+	tblLevel = 1.0F;
 
 	optVerbose = false;
 	optWholedata = false;
 	optRaw = false;
 	optThroughCalibration = false;
 	optSerialNo = 0;
+	optEngine = ENGINE_GABOR;
+	optThreads = 1;
+	optTrack = false;
 
-	memset(rawECG, 0, sizeof(rawECG));
-	idxECG = 0;
+	rawECG = &ownECG;
 	serialNo = 0;
+	headerRetries = 0;
+	header.endTime = -1.0;
+	gaborCalls = 0;
+	gaborRows = 0;
+	gaborGated = 0;
+	trackHits = 0;
+	trackFallbacks = 0;
+	trackIndex = 0;
+	trackPrevF = -1;
 	procTime = CTime::GetCurrentTime();
 }
 
 Convert2ECG::~Convert2ECG(void)
 {
-	if (gtbl) 		free(gtbl);
 	if (pcmdata)	free(pcmdata);
+	if (pcm16)	free(pcm16);
+	releaseChannels();
+	if (stream)		delete stream;
 }
 
+void Convert2ECG::startStage(int stage)
+{
+	timer.start(stage);
+}
+
+void Convert2ECG::stopStage(int stage)
+{
+	timer.stop(stage);
+}
+
+/*
+ Kernel of the sampling rate from the table set. (own set, or shared by batch)
+ */
 int Convert2ECG::setupGTable( int samplingrate, std::string currentPaht )
 {
-	std::ifstream fs;
-	std::string gtblPath = std::string(currentPaht);
-	gtblPath.append((samplingrate == SamplingRate441) ? tblFilePath441 : tblFilePath480);
+	if (!tables->isReady())
+		tables->init(currentPaht, optVerbose, optDebug);
 
-	fs.open(gtblPath.c_str(), std::ios::in | std::ios::binary);
-	if (fs.fail()) {
-		std::cerr << "Error! cannot open GDataFile:" << gtblPath.c_str() << "\n";
+	gkernel = tables->get(samplingrate, &tblLevel);
+	if (!gkernel)
 		return -1;
-	}
 
-	fs.seekg(0, std::ios::end);
-	std::streamsize dataSize = fs.tellg();
-	fs.clear();
-	fs.seekg(0, std::ios::beg);
+	return ERR_OK;
+}
 
-	gtbl = (gaborFactorTbl *)malloc((size_t)dataSize);
-	if (!gtbl) {
-		std::cerr << "Error! out of memory. (" << dataSize << ")Byte\n";
+/*
+ 16 bit kernel and PCM for gabor_transform. (-e int16)
+ pcm16 is a copy of pcmdata, a position pcmdata + index reads pcm16[index].
+ The float samples are kept, -X validates with them. (run after the gate)
+ */
+int Convert2ECG::setupFixedKernel(void)
+{
+	gkernel16 = tables->getFixed(samplingRateI);
+	pcm16 = (__int16 *)malloc(pcmLength * sizeof(__int16));
+	if (!gkernel16 || !pcm16) {
+		std::cerr << "Error! out of memory. (int16 kernel)\n";
 		return -1;
 	}
-
-	fs.read((char *)gtbl, dataSize);
-	if (fs.fail()) {
-		std::cerr << "Error! cannot read GDataFile:" << gtblPath.c_str() << "\n";
-		return -1;
+	for (int i=0; i<pcmLength; i++) {
+		float v = pcmdata[i] * (float)SHRT_MAX;
+		if (v > SHRT_MAX)	v = SHRT_MAX;
+		if (v < -SHRT_MAX)	v = -SHRT_MAX;
+		pcm16[i] = (__int16)floorf(v + 0.5F);
 	}
+	fixedKernel = true;
 
-	fs.close();
-
+	if (optVerbose) {
+		float bound = 0.0F;
+		for (int r=0; r<tbl_size; r++) {
+			if (gkernel16->getBound(r, tbl_minf) > bound)
+				bound = gkernel16->getBound(r, tbl_minf);
+		}
+		std::cout << "int16 kernel error bound: " << bound << " (full scale, threshold " << thresholdLevel << ")\n";
+	}
 	return ERR_OK;
 }
 
-typedef struct {
-	union {
-		char	chankId[4];
-		__int32 chankIdVal;
-	};
-	__int32	chankSize;
-} _chankHeader;
-
-#define CHANK_RIFF	0x46464952		//  'RIFF'
-#define CHANK_WAVE	0x45564157		//  'WAVE'
-#define CHANK_fmt	0x20746d66		//	'fmt '
-#define CHANK_data	0x61746164		//	'data'
-
-
-typedef struct {
-	__int16	 wFormatTag;		// LinearPCM:	1
-	__int16	 wChannels;			// Monoral:		1
-	__int32	 dwSamplesPerSec;	// 44100
-	__int32	 dwAvgBytesPerSec;	// 44100*2
-	__int16 wBlockAlign;		// 2
-	__int16 wBitsPerSample;		// 16
-} _fmtChunk;
+void Convert2ECG::shareTables( GaborTableSet *set )
+{
+	tables = set;
+}
+
+/*
+ Store the data samples in buf. (batch worker, reused for every file)
+ */
+void Convert2ECG::shareECGBuffer( ECGBuffer *buf )
+{
+	rawECG = buf;
+	rawECG->clear();
+}
 
 int Convert2ECG::loadSoundData( const char* soundf )
 {
-	int samples = 0;
-	_chankHeader chk;
-	std::ifstream fs;
+	if (sound.open(soundf))
+		return -1;
+	return readSoundData();
+}
 
-	fs.open(soundf, std::ios::in | std::ios::binary);
-	if (fs.fail()) {
-		std::cerr << "Error! cannot open input file:" << soundf << "\n";
+/*
+ WAV file in memory. (server job) wav must live until convert returns.
+ */
+int Convert2ECG::setSoundData( const char *wav, int size )
+{
+	if (sound.attach(wav, size))
+		return -1;
+	return readSoundData();
+}
+
+/*
+ The down mix to pcmdata. the channels stay in the WAV. (selectChannel)
+ */
+int Convert2ECG::readSoundData(void)
+{
+	int samples = sound.getFrames();
+
+	channels = sound.getChannels();
+	if (sound.getSamplingRate() >= MinSamplingRate && sound.getSamplingRate() <= MaxSamplingRate) {
+		samplingRateI = sound.getSamplingRate();
+		samplingRateF = (float)samplingRateI;
+	}
+	else {
+		std::cerr << "Error! Samplingrate is out of range:" << sound.getSamplingRate() << "\n";
+		return -1;
+	}
+	if (samples == 0) {
+		std::cerr << "Error! wave file has no data. \n";
 		return -1;
 	}
+	pcmdata = (float *)malloc((samples+samplingRateI) * sizeof(float));
+	if (!pcmdata) {
+		std::cerr << "Error! out of memory. (pcmdata)\n";
+		return -1;
+	}
+	pcmLength = samples+samplingRateI;
+	int pad = samplingRateI/2;
+	memset(pcmdata, 0, pad * sizeof(float));
+	memset(&pcmdata[pad + samples], 0, (pcmLength - pad - samples) * sizeof(float));
 
-	while (1) {
-		fs.read((char *)&chk, sizeof(chk));
-		if (fs.fail()) {
-			std::cerr << "Error! wav file '" << soundf << "' is broken. \n";
-			return -1;
-		}
-		if (chk.chankIdVal == CHANK_RIFF) {
-			_int32 tagWave;
-			fs.read((char *)&tagWave, sizeof(tagWave));
-			if (tagWave != CHANK_WAVE) {
-				std::cerr << "Error! wav file is not 'WAVE' format\n";
-				return -1;
-			}
-		}
-		else if (chk.chankIdVal == CHANK_fmt) {
-			_fmtChunk fmt;
-			memset(&fmt, 0, sizeof(fmt));
-			if (chk.chankSize < sizeof(fmt)) {
-				std::cerr << "Error! 'fmt ' chank size is worng:" << chk.chankSize << "\n";
-				return -1;
-			}
-			fs.read((char *)&fmt, sizeof(fmt));
-			if (fmt.wFormatTag != 1) {
-				std::cerr << "Error! wave file is not Linear PCM:" << fmt.wFormatTag << "\n";
-				return -1;
-			}
-			if (fmt.wChannels != 1) {
-				std::cerr << "Error! wave file is not MONORAL:" << fmt.wChannels << "\n";
-				return -1;
+	if (sound.read(&pcmdata[pad]))
+		return -1;							// reported.
+
+	durationPCMTime = samples/samplingRateF;
+	if (optVerbose) {
+		std::cout << "Channels:" << channels << "\n";
+		std::cout << "SampleFormat:" << ((sound.getFormat() == WavFile::FormatFloat) ? "float " : "int ")
+				  << sound.getBitsPerSample() << " bit\n";
+		std::cout << "SamplingRate:" << samplingRateI << "\n";
+		std::cout << "PCM Samples:" << samples << "\n";
+		std::cout << "\t" << durationPCMTime << " sec\n";
+	}
+
+	return ERR_OK;
+}
+
+/*
+ Multi-channel input: a noisy or phase-inverted channel can cancel the FSK
+ tones in the down mix. The header is searched on the down mix, on every
+ channel and (stereo) on the difference of the channels, each on its own
+ thread. Of the candidates that lock first (within ChannelLockTolerance)
+ pcmdata becomes the one with the best tone score (probeHeader); the down
+ mix is kept unless another is ChannelScoreMargin times better, so a clean
+ recording converts as before. No lock at all: the down mix, detectHeader
+ reports it.
+ Only the first ChannelProbeTime seconds are probed (doubled while no
+ candidate locks inside), so the candidates are short copies; a WAV
+ channel is converted from the file for them, and the selected one is
+ converted over pcmdata. The header of the selected one is kept, so
+ convetECGData does not detect it again.
+ */
+int Convert2ECG::selectChannel(std::string currentPath)
+{
+	bool wavChannels = (sound.getChannels() > 1);
+	if (channels > MaxChannels || (!wavChannels && !channelData[0]))
+		return ERR_OK;						// too many channels, down mix only.
+	if (!tables->isReady())
+		tables->init(currentPath, optVerbose, optDebug);
+
+	// [0] down mix, [1..channels] channel, [channels+1] difference. (stereo)
+	int count = channels + ((channels == 2) ? 2 : 1);
+	int pad = samplingRateI/2;
+	int samples = pcmLength - samplingRateI;
+	std::vector<channelProbe> probes(count);
+	std::vector<bool> copied(count, false);
+	int err = ERR_OK;
+	int first = -1;
+	int best = 0;
+	double duration = 0.0;
+
+	for (double probeTime = ChannelProbeTime; ; probeTime *= 2.0) {
+		int frames = (probeTime*samplingRateF < samples) ? (int)(probeTime*samplingRateF) : samples;
+		int length = frames + samplingRateI;
+		int filled = (frames + pad < samples) ? frames + pad : samples;	// the kernel reads on.
+		duration = frames/samplingRateF;
+
+		probes[0].pcm = pcmdata;
+		for (int i=1; i<count && err == ERR_OK; i++) {
+			if (!wavChannels && i <= channels) {
+				probes[i].pcm = channelData[i-1];
+				continue;
 			}
-			if (fmt.dwSamplesPerSec == SamplingRate441 || fmt.dwSamplesPerSec == SamplingRate480) {
-				samplingRateI = fmt.dwSamplesPerSec;
-				samplingRateF = (float)fmt.dwSamplesPerSec;
+			float *p = (float *)realloc(copied[i] ? probes[i].pcm : nullptr, length * sizeof(float));
+			if (!p) {
+				std::cerr << "Error! out of memory. (channel pcm)\n";
+				err = -1;
+				break;
 			}
+			probes[i].pcm = p;
+			copied[i] = true;
+			memset(p, 0, length * sizeof(float));
+			if (wavChannels)
+				err = sound.readChannel((i <= channels) ? i-1 : -1, 0, filled, &p[pad]);
 			else {
-				std::cerr << "Error! Samplingrate is not 44100 or 48000:" << fmt.dwSamplesPerSec << "\n";
-				return -1;
-			}
-			if (fmt.wBitsPerSample != 16) {
-				std::cerr << "Error! Sampl data size is not 16bits:" << fmt.wBitsPerSample << "\n";
-				return -1;
+				for (int k=pad; k<pad+filled; k++)
+					p[k] = (channelData[0][k] - channelData[1][k]) * 0.5F;
 			}
 		}
-		else if (chk.chankIdVal == CHANK_data) {
-			samples = chk.chankSize/2;
+		if (err)
+			break;
+
+		for (int i=0; i<count; i++) {
+			probes[i].length = copied[i] ? length : pcmLength;
+			probes[i].duration = duration;
+		}
+		std::vector<std::thread> workers;
+		for (int i=1; i<count; i++)
+			workers.push_back(std::thread(&Convert2ECG::probeHeader, this, &probes[i]));
+		probeHeader(&probes[0]);
+		for (size_t i=0; i<workers.size(); i++)
+			workers[i].join();
+
+		first = -1;
+		for (int i=0; i<count; i++) {
+			double lock = probes[i].result.endTime;
+			if (lock >= 0.0 && (first < 0 || lock < probes[first].result.endTime))
+				first = i;
+		}
+		// a later candidate within the tolerance (and its score) must be inside too.
+		if (frames == samples || (first >= 0 && probes[first].result.endTime + ChannelLockTolerance + 1.0 < duration))
 			break;
+	}
+
+	for (int i=0; err == ERR_OK && first >= 0 && i<count; i++) {
+		double limit = probes[first].result.endTime + ChannelLockTolerance;
+		if (probes[i].result.endTime < 0.0 || probes[i].result.endTime > limit)
+			continue;
+		float need = (best == 0 && probes[0].result.endTime >= 0.0) ? probes[0].score * ChannelScoreMargin : probes[best].score;
+		if (probes[best].result.endTime < 0.0 || probes[best].result.endTime > limit || probes[i].score > need)
+			best = i;
+	}
+
+	if (optVerbose && err == ERR_OK) {
+		std::cout << "Channel selection: (" << duration << " sec)\n";
+		for (int i=0; i<count; i++) {
+			std::cout << "\t" << ((i == 0) ? "down mix" : (i <= channels) ? "channel " : "difference");
+			if (i > 0 && i <= channels)
+				std::cout << i;
+			if (probes[i].result.endTime >= 0.0)
+				std::cout << " : header " << probes[i].result.endTime << " sec, score " << probes[i].score;
+			else
+				std::cout << " : no header";
+			std::cout << ((i == best) ? " <--\n" : "\n");
+		}
+	}
+
+	selectedChannel = (best <= channels) ? best : -1;
+	if (err == ERR_OK && probes[best].result.endTime >= 0.0)
+		header = probes[best].result;				// the same samples, not detected again.
+	if (err == ERR_OK && best > 0) {
+		// the whole of the selected one over the down mix.
+		if (wavChannels)
+			err = sound.readChannel((best <= channels) ? best-1 : -1, 0, samples, &pcmdata[pad]);
+		else if (best <= channels) {
+			free(pcmdata);
+			pcmdata = channelData[best-1];
+			channelData[best-1] = nullptr;	// owned by pcmdata now.
 		}
 		else {
-			// onother chank! skip it.
-			fs.seekg(chk.chankSize, std::ios::cur);
+			for (int k=0; k<pcmLength; k++)
+				pcmdata[k] = (channelData[0][k] - channelData[1][k]) * 0.5F;
 		}
 	}
+	for (int i=0; i<count; i++) {
+		if (copied[i])	free(probes[i].pcm);
+	}
+	return err;
+}
 
-	if (samples == 0) {
-		std::cerr << "Error! wave file has no data. \n";
+/*
+ detectHeader on probe->pcm (same layout as pcmdata, length samples) by a
+ probe converter, up to duration sec of the data.
+ result: detectHeader of the probe, endTime -1 when not found.
+ score: mean peak / mean row of the Gabor transform over the calibration
+ part after the header, a tone to noise ratio that does not depend on the
+ level of the candidate.
+ */
+void Convert2ECG::probeHeader(channelProbe *candidate)
+{
+	float *pcm = candidate->pcm;
+	int length = candidate->length;
+	headerResult *result = &candidate->result;
+	float *score = &candidate->score;
+	const int kScorePoints = 20;
+	const double kScoreStep = 0.01;		// sec
+	float wt[128];
+
+	Convert2ECG probe;
+	probe.shareTables(tables);
+	probe.samplingRateI = samplingRateI;
+	probe.samplingRateF = samplingRateF;
+	probe.pcmdata = pcm;
+	probe.pcmLength = length;
+	probe.durationPCMTime = candidate->duration;
+	probe.optThreads = 1;					// the candidates are in parallel.
+
+	if (probe.setupGTable(samplingRateI, "") == ERR_OK &&
+		probe.gate.build(pcm, length, *probe.gkernel, tbl_minf, thresholdLevel) == 0) {
+		probe.memoActive = (probe.memo.setup() == 0);
+		probe.detectHeader();
+	}
+	*result = probe.header;
+	*score = 0.0F;
+	for (int k=0; result->endTime >= 0.0 && k<kScorePoints; k++) {
+		float *p = probe.getPcmp(result->endTime + k*kScoreStep);
+		if (!p)
+			break;
+		probe.gabor_transform(p, 1000, 10, wt, 128);
+		float peak = 0.0F, sum = 0.0F;
+		for (int y=0; y<128; y++) {
+			sum += wt[y];
+			if (wt[y] > peak) peak = wt[y];
+		}
+		if (sum > 0.0F)
+			*score += peak * 128 / sum / kScorePoints;
+	}
+	gaborCalls += probe.gaborCalls;
+	gaborRows += probe.gaborRows;
+	gaborGated += probe.gaborGated;
+	probe.pcmdata = nullptr;				// not owned.
+}
+
+void Convert2ECG::releaseChannels(void)
+{
+	for (int c=0; c<MaxChannels; c++) {
+		if (channelData[c])	free(channelData[c]);
+		channelData[c] = nullptr;
+	}
+}
+
+/*
+ Low-pass and reduce pcmdata to the lowest rate above the G-Table band. (-D)
+ */
+int Convert2ECG::decimatePcm(void)
+{
+	Decimator dec;
+	if (dec.setup(samplingRateI, MinSamplingRate, tbl_maxf)) {
+		std::cerr << "Error! out of memory. (decimator)\n";
 		return -1;
 	}
-	pcmdata = (float *)malloc((samples+samplingRateI) * sizeof(float));
-	if (!pcmdata) {
+	if (dec.getFactor() == 1)
+		return ERR_OK;						// already low.
+
+	int rate = dec.getRate();
+	int samples = pcmLength - (samplingRateI/2)*2;
+	int count = samples / dec.getFactor();
+	int length = count + (rate/2)*2;
+	float *pcm = (float *)malloc(length * sizeof(float));
+	if (!pcm) {
 		std::cerr << "Error! out of memory. (pcmdata)\n";
 		return -1;
 	}
-	memset(pcmdata, 0, (samples+samplingRateI) * sizeof(float));
+	memset(pcm, 0, length * sizeof(float));
+	dec.run(&pcmdata[samplingRateI/2], &pcm[rate/2], count);
 
-	__int16 *readPcm = (__int16 *)malloc(samples * sizeof(__int16));
-	if (!readPcm) {
-		std::cerr << "Error! out of memory. (read pcm)\n";
-		return -1;
+	if (optVerbose) {
+		std::cout << "Decimated: " << samplingRateI << " --> " << rate << "Hz (taps:" << dec.getTaps() << ")\n";
 	}
-	fs.read((char *)readPcm, samples * sizeof(__int16));
+	free(pcmdata);
+	pcmdata = pcm;
+	pcmLength = length;
+	samplingRateI = rate;
+	samplingRateF = (float)rate;
+	return ERR_OK;
+}
 
-	float *pcmf = &pcmdata[samplingRateI/2];
-	for (int i=0; i<samples; i++) {
-		*pcmf++ = (float)readPcm[i] / (float)SHRT_MAX;
+/*
+ Decode the MP3 file in-process, straight into pcmdata.
+ */
+int Convert2ECG::decodeMp3(Arguments arg)
+{
+	char pathInput[_MAX_PATH];
+	Mp3Decoder decoder;
+
+	arg.getMp3FilePath(pathInput, _MAX_PATH);
+	timer.start(StageTimer::StageDecode);
+	int err = decoder.decode(pathInput);
+	timer.stop(StageTimer::StageDecode);
+	if (err) {
+		std::cerr << "Error! cannot decode mp3 file:" << pathInput << "\n";
+		return -1;
+	}
+	if (decoder.getSamplingRate() < MinSamplingRate || decoder.getSamplingRate() > MaxSamplingRate) {
+		std::cerr << "Error! Samplingrate is out of range:" << decoder.getSamplingRate() << "\n";
+		return -1;
 	}
 
-	free(readPcm);
+	samplingRateI = decoder.getSamplingRate();
+	samplingRateF = (float)samplingRateI;
+	int samples = decoder.getSamples();
+	pcmdata = decoder.detach(&pcmLength);
+	channels = decoder.getChannels();
+	for (int c=0; c<channels && c<MaxChannels; c++)
+		channelData[c] = decoder.detachChannel(c);
 
 	durationPCMTime = samples/samplingRateF;
-	if (optVerbose) {
+	if (arg.opt_v) {
+		std::cout << "Decoded MP3 (channels:" << decoder.getChannels() << ")\n";
 		std::cout << "SamplingRate:" << samplingRateI << "\n";
 		std::cout << "PCM Samples:" << samples << "\n";
 		std::cout << "\t" << durationPCMTime << " sec\n";
@@ -186,6 +465,33 @@ int Convert2ECG::loadSoundData( const char* soundf )
 	return ERR_OK;
 }
 
+/*
+ Open the WAV stream. (-p) the samples are read while converting.
+ */
+int Convert2ECG::openStream(Arguments arg)
+{
+	char pathInput[_MAX_PATH];
+
+	arg.getMp3FilePath(pathInput, _MAX_PATH);
+	stream = new PcmStream;
+	if (stream->open(pathInput))
+		return -1;
+	if (stream->getSamplingRate() < MinSamplingRate || stream->getSamplingRate() > MaxSamplingRate) {
+		std::cerr << "Error! Samplingrate is out of range:" << stream->getSamplingRate() << "\n";
+		return -1;
+	}
+
+	samplingRateI = stream->getSamplingRate();
+	samplingRateF = (float)samplingRateI;
+	durationPCMTime = 0.0;					// not known until the end.
+	if (arg.opt_v) {
+		std::cout << "Streaming input:" << pathInput << "\n";
+		std::cout << "SamplingRate:" << samplingRateI << "\n";
+	}
+
+	return ERR_OK;
+}
+
 #include <Windows.h>
 int Convert2ECG::convert(Arguments arg)
 {
@@ -201,25 +507,117 @@ int Convert2ECG::convert(Arguments arg)
 	optDataOnly = arg.donlyStartTime;	// start time, convert only Data Section. 
 	optThroughCalibration = arg.opt_c;
 	optDebug = arg.opt_X;
+	optEngine = arg.engine;
+	optTrack = arg.opt_T;
+	optThreads = (arg.threads > 0) ? arg.threads : (int)std::thread::hardware_concurrency();
+	if (optThreads < 1)
+		optThreads = 1;
+
+	if (arg.opt_p) {
+		err = openStream(arg);
+		if (err) return err;
+	}
+	else if (!pcmdata) {				// not decoded in-process.
+		if (arg.isWaveInput())
+			arg.getMp3FilePath(pathInput, _MAX_PATH);	// read in place, no ffmpeg.
+		else
+			arg.getWavFilePath(pathInput, _MAX_PATH);
+		timer.start(StageTimer::StageLoad);
+		err = loadSoundData(pathInput);
+		timer.stop(StageTimer::StageLoad);
+		if (err) return err;
+	}
 
-	arg.getWavFilePath(pathInput, _MAX_PATH);
-	err = loadSoundData(pathInput);
-	if (err) return err;
+	if (channels > 1 && !stream && !optWholedata && optDataOnly == 0.0) {
+		timer.start(StageTimer::StageChannel);
+		err = selectChannel(arg.currentPath);
+		timer.stop(StageTimer::StageChannel);
+		if (err) return err;
+	}
+	releaseChannels();
+	sound.close();
+
+	if (arg.opt_D && !stream) {
+		header.endTime = -1.0;				// detected again at the new rate.
+		timer.start(StageTimer::StageDecimate);
+		err = decimatePcm();
+		timer.stop(StageTimer::StageDecimate);
+		if (err) return err;
+	}
 
+	timer.start(StageTimer::StageGTable);
 	err = setupGTable(samplingRateI, arg.currentPath);
+	timer.stop(StageTimer::StageGTable);
 	if (err) return err;
 
+	if (stream) {
+		// header re-detection steps back up to the sweep start.
+		int reach = gkernel->getReach();
+		if (stream->setup((int)(StreamHistoryTime*samplingRateF) + reach, reach)) {
+			std::cerr << "Error! out of memory. (stream)\n";
+			return -1;
+		}
+		if (optEngine != ENGINE_GABOR || arg.opt_D) {
+			std::cerr << "Warning! -e and -D are not available for stream input.\n";
+			optEngine = ENGINE_GABOR;
+		}
+	}
+
+	timer.start(StageTimer::StagePrepare);
+	if (!stream) {
+		// skip the search where the audio is too weak for any peak.
+		err = gate.build(pcmdata, pcmLength, *gkernel, tbl_minf, thresholdLevel);
+		if (err) {
+			timer.stop(StageTimer::StagePrepare);
+			std::cerr << "Error! out of memory. (gate)\n";
+			return err;
+		}
+		if (optVerbose) {
+			std::cout << "Gate: " << (int)(gate.getDeadRatio()*100.0F) << "% skipped\n";
+		}
+	}
+
+	if (!stream && !optDebug) {
+		// rows evaluated again by the retries. (-X switches the kernel)
+		if (memo.setup()) {
+			timer.stop(StageTimer::StagePrepare);
+			std::cerr << "Error! out of memory. (memo)\n";
+			return -1;
+		}
+		memoActive = true;
+	}
+
+	if (optEngine == ENGINE_FIXED) {
+		// gabor_transform reads pcm16 after this. (float with -X)
+		err = setupFixedKernel();
+		if (err) {
+			timer.stop(StageTimer::StagePrepare);
+			return err;
+		}
+	}
+	timer.stop(StageTimer::StagePrepare);
+
 	err = pcm2ecg();
+	if (stream && optVerbose) {
+		std::cout << "Stream: " << stream->getSamples() << " samples, window "
+				  << stream->getCapacity()*sizeof(float)/1024 << " KByte\n";
+	}
 	if (err) return err;
 
 	char fpath[MAX_PATH];
 	arg.getEcgFilePath(fpath, sizeof(fpath));
-	if (optRaw) {
+	timer.start(StageTimer::StageOutput);
+	if (arg.opt_B) {
+		arg.getBinaryPath(fpath, sizeof(fpath));
+		outECGBinary(fpath);
+	}
+	else if (optRaw) {
 		outECGRaw(fpath);
 	}
 	else {
 		outECG(fpath);
 	}
+	timer.stop(StageTimer::StageOutput);
 
 	return ERR_OK;
 }
@@ -234,54 +632,47 @@ int Convert2ECG::pcm2ecg( void )
 #endif
 	double offsetTime = samplingRateF/2.0;
 
-	if (optWholedata)
+	if (optWholedata) {
+		timer.start(StageTimer::StageData);
 		err = covertWholeData();
+		timer.stop(StageTimer::StageData);
+	}
 	else
 		err = convetECGData();
 
+	if (streamError)
+		return ERR_OTHER;					// the data stopped at the stream error.
 	return err;
 }
 
 void Convert2ECG::outECGRaw(char *fpath)
 {
-	std::ofstream fs;
+	OutputFile out;
 
-	fs.open(fpath, std::ios::out);
-	if (fs.fail()) {
-		std::cerr << "Error! cannot open output file:" << fpath << "\n";
-		return;
-	}
-
-	for (int i=0; i<idxECG; i++)
-		fs << rawECG[i] << "\n";
+	for (int i=0; i<rawECG->size(); i++)
+		out.put((*rawECG)[i]).endl();
 
-	fs.close();
+	if (out.commit(fpath))
+		std::cerr << "Error! cannot write output file:" << fpath << "\n";
 }
 
-
-void Convert2ECG::outECG(char *fpath)
+/*
+ Header lines of the .ecg file, up to [ECG Event1].
+ */
+void Convert2ECG::putECGHeader(OutputFile &out)
 {
-	static const int offsetECGValue = 1700;
-	std::ofstream fs;
-
-	fs.open(fpath, std::ios::out);
-	if (fs.fail()) {
-		std::cerr << "Error! cannot open output file:" << fpath << "\n";
-		return;
-	}
-
-	fs << "[TRANSMISSION HEADER]\n";
-
-    fs << "Version=3.7.0.4\n";
-    fs << "DeviceSoftwareCode=24\n";
-    fs << "SampleRate=225\n";
-    fs << "DynamicRange=6\n";
-    fs << "EventsNumber=1\n";
-    fs << "SamplesNumberInEvent=" << idxECG << "\n";
-    fs << "PostEventInSec=0\n";
-    fs << "LeadsNumber=1\n";
-    fs << "[HEADER Event1]\n";
-    fs << "EventDate=";
+	out.put("[TRANSMISSION HEADER]").endl();
+
+    out.put("Version=3.7.0.4").endl();
+    out.put("DeviceSoftwareCode=24").endl();
+    out.put("SampleRate=225").endl();
+    out.put("DynamicRange=6").endl();
+    out.put("EventsNumber=1").endl();
+    out.put("SamplesNumberInEvent=").put(rawECG->size()).endl();
+    out.put("PostEventInSec=0").endl();
+    out.put("LeadsNumber=1").endl();
+    out.put("[HEADER Event1]").endl();
+    out.put("EventDate=");
 
 	const int dtimeLength = 64;
 	WCHAR  strWch[dtimeLength];
@@ -292,25 +683,61 @@ void Convert2ECG::outECG(char *fpath)
 	setlocale(LC_ALL,"japanese");
 	size_t datelen = dtimeLength;
 	wcstombs_s(&datelen, str, dtimeLength, strWch, _TRUNCATE);
-	fs << str << "\n";
+	out.put(str).endl();
 	
-	fs << "EventTime=";
+	out.put("EventTime=");
 //	CString ptime = procTime.FormatGmt(L"%H:%M");
 	CString ptime = procTime.Format(L"%H:%M");
 	_tcscpy_s( strWch, ptime );
 	datelen = dtimeLength;
 	wcstombs_s(&datelen, str, dtimeLength, strWch, _TRUNCATE);
-	fs << str << "\n";
+	out.put(str).endl();
 
-    fs << "DateTimeOfRecording=No\n";
-    fs << "EventAuto=No\n";
-    fs << "MonitorSerialNumber=" << serialNo << "\n";
-    fs << "[ECG Event1]\n";
+    out.put("DateTimeOfRecording=No").endl();
+    out.put("EventAuto=No").endl();
+    out.put("MonitorSerialNumber=").put(serialNo).endl();
+    out.put("[ECG Event1]").endl();
+}
 
-	for (int i=0; i<idxECG; i++)
-		fs << offsetECGValue -rawECG[i] << "\n";
+void Convert2ECG::outECG(char *fpath)
+{
+	OutputFile out;
 
-	fs.close();
+	putECGHeader(out);
+	for (int i=0; i<rawECG->size(); i++)
+		out.put(offsetECGValue -(*rawECG)[i]).endl();
+
+	if (out.commit(fpath))
+		std::cerr << "Error! cannot write output file:" << fpath << "\n";
+}
+
+/*
+ Same data as outECG / outECGRaw in the binary format. (-B, see OutputFile.h)
+ */
+void Convert2ECG::outECGBinary(char *fpath)
+{
+	OutputFile header;
+	header.setNewline("\n");
+	if (!optRaw)
+		putECGHeader(header);
+
+	OutputFile out;
+	unsigned char version = OutputFile::kBinaryVersion;
+	out.putBytes(OutputFile::kBinaryMagic, sizeof(OutputFile::kBinaryMagic));
+	out.putBytes(&version, 1);
+	out.putVarint(header.getLength());
+	out.putBytes(header.getData(), header.getLength());
+	out.putVarint(rawECG->size());
+
+	int last = 0;
+	for (int i=0; i<rawECG->size(); i++) {
+		int val = optRaw ? (*rawECG)[i] : offsetECGValue -(*rawECG)[i];
+		out.putZigzag(val - last);
+		last = val;
+	}
+
+	if (out.commit(fpath))
+		std::cerr << "Error! cannot write output file:" << fpath << "\n";
 }
 
 /*
@@ -321,20 +748,14 @@ TimeStamp=2015/11/17 15:19:11
 
 void Convert2ECG::outStatus(Arguments arg, int status)
 {
-	std::ofstream fs;
+	OutputFile out;
 	char fpath[_MAX_PATH];
 
 	arg.getStatusPath(fpath, sizeof(fpath));
 
-	fs.open(fpath, std::ios::out);
-	if (fs.fail()) {
-		std::cerr << "Error! cannot create status file:" << fpath << "\n";
-		return;
-	}
-
-	fs << "Status=" << status << "\n";
-    fs << "SerialNo=" << serialNo << "\n";
-    fs << "TimeStamp=";
+	out.put("Status=").put(status).endl();
+    out.put("SerialNo=").put(serialNo).endl();
+    out.put("TimeStamp=");
 
 
 	const int dtimeLength = 64;
@@ -345,9 +766,86 @@ void Convert2ECG::outStatus(Arguments arg, int status)
 	setlocale(LC_ALL,"japanese");
 	size_t datelen = dtimeLength;
 	wcstombs_s(&datelen, str, dtimeLength, strWch, _TRUNCATE);
-	fs << str << "\n";
-	
-	fs.close();
+	out.put(str).endl();
+
+	// stage report. (msec)
+	double total = timer.getTotal();
+	for (int s=0; s<StageTimer::StageCount; s++)
+		out.put(StageTimer::getName(s)).put("Time=").putFixed(timer.getTime(s)*1000.0).endl();
+	out.put("TotalTime=").putFixed(total*1000.0).endl();
+	out.put("AudioTime=").putFixed(durationPCMTime*1000.0).endl();
+	out.put("RealtimeFactor=").putFixed((total > 0.0) ? durationPCMTime/total : 0.0).endl();
+	out.put("Channels=").put(channels).endl();
+	out.put("Channel=").put(selectedChannel).endl();
+	out.put("HeaderRetries=").put(headerRetries).endl();
+	out.put("GaborCalls=").put(gaborCalls).endl();
+	out.put("GaborRows=").put(gaborRows).endl();
+	out.put("GaborGated=").put(gaborGated).endl();
+	out.put("GaborMemoHits=").put(memo.getHits()).endl();
+	out.put("GaborMemoMisses=").put(memo.getMisses()).endl();
+	out.put("TrackHits=").put(trackHits).endl();
+	out.put("TrackFallbacks=").put(trackFallbacks).endl();
+	out.put("PeakMemory=").put((long long)(StageTimer::getPeakMemory()/1024)).endl();		// KByte
+
+	if (out.commit(fpath))
+		std::cerr << "Error! cannot create status file:" << fpath << "\n";
+
+	if (optVerbose) {
+		std::cout << "\n- - - - - - - - - - - -\n";
+		std::cout << "Stage Time.\n";
+		for (int s=0; s<StageTimer::StageCount; s++) {
+			if (timer.getTime(s) > 0.0)
+				std::cout << "\t" << StageTimer::getName(s) << " : " << timer.getTime(s)*1000.0 << " msec\n";
+		}
+		std::cout << "\ttotal : " << total*1000.0 << " msec (x" << ((total > 0.0) ? durationPCMTime/total : 0.0) << " realtime)\n";
+		std::cout << "\tgabor : " << gaborCalls << " calls, " << gaborRows << " rows, " << gaborGated << " gated\n";
+		std::cout << "\tmemo  : " << memo.getHits() << " hits, " << memo.getMisses() << " misses\n";
+		if (optTrack)
+			std::cout << "\ttrack : " << trackHits << " hits, " << trackFallbacks << " fallbacks\n";
+	}
+	if (arg.opt_J)
+		outReport(arg, status, total);
+}
+
+/*
+ Same report as JSON. (-J)
+ */
+void Convert2ECG::outReport(Arguments arg, int status, double total)
+{
+	OutputFile out;
+	char fpath[_MAX_PATH];
+
+	arg.getReportPath(fpath, sizeof(fpath));
+	out.setNewline("\n");
+
+	out.put("{").endl();
+	out.put("  \"status\": ").put(status).put(",").endl();
+	out.put("  \"serialNo\": ").put(serialNo).put(",").endl();
+	out.put("  \"samplingRate\": ").put(samplingRateI).put(",").endl();
+	out.put("  \"stages\": {").endl();
+	for (int s=0; s<StageTimer::StageCount; s++) {
+		out.put("    \"").put(StageTimer::getName(s)).put("\": ").putFixed(timer.getTime(s)*1000.0);
+		out.put((s+1 < StageTimer::StageCount) ? "," : "").endl();
+	}
+	out.put("  },").endl();
+	out.put("  \"totalTime\": ").putFixed(total*1000.0).put(",").endl();
+	out.put("  \"audioTime\": ").putFixed(durationPCMTime*1000.0).put(",").endl();
+	out.put("  \"realtimeFactor\": ").putFixed((total > 0.0) ? durationPCMTime/total : 0.0).put(",").endl();
+	out.put("  \"channels\": ").put(channels).put(",").endl();
+	out.put("  \"channel\": ").put(selectedChannel).put(",").endl();
+	out.put("  \"headerRetries\": ").put(headerRetries).put(",").endl();
+	out.put("  \"gaborCalls\": ").put(gaborCalls).put(",").endl();
+	out.put("  \"gaborRows\": ").put(gaborRows).put(",").endl();
+	out.put("  \"gaborGated\": ").put(gaborGated).put(",").endl();
+	out.put("  \"gaborMemoHits\": ").put(memo.getHits()).put(",").endl();
+	out.put("  \"gaborMemoMisses\": ").put(memo.getMisses()).put(",").endl();
+	out.put("  \"trackHits\": ").put(trackHits).put(",").endl();
+	out.put("  \"trackFallbacks\": ").put(trackFallbacks).put(",").endl();
+	out.put("  \"peakMemory\": ").put((long long)(StageTimer::getPeakMemory()/1024)).endl();
+	out.put("}").endl();
+
+	if (out.commit(fpath))
+		std::cerr << "Error! cannot create report file:" << fpath << "\n";
 }
 
 int Convert2ECG::covertWholeData(void)
@@ -355,21 +853,30 @@ int Convert2ECG::covertWholeData(void)
 	const int startinglength = 10;
 	const int terminatelength = 100;
 
-	int pcmOffset = samplingRateI/2;
 	double currentTime = 0.0;
 	int val;
 
 	int count = 0;
-	while (currentTime < durationPCMTime) {
-		int pcmidx = pcmOffset+(int)(currentTime*samplingRateF);
+	float *pcm;
+	if (optEngine == ENGINE_DEMOD) {
+		if (demod.setup(pcmdata, pcmLength, samplingRateF, tbl_minf, tbl_maxf, GaborSigma, tblLevel)) {
+			std::cerr << "Error! cannot setup demod engine.\n";
+			return ERR_OTHER;
+		}
+	}
+	while ((pcm = getPcmp(currentTime)) != 0) {
 		currentTime += 1.0/DataRate;
-		val = fast_fcnv(&pcmdata[pcmidx], 1100, 2300, 1);
-		rawECG[idxECG++] = val;
-		if (idxECG >= MaxECGTable)
-			break;
+		if (optEngine == ENGINE_DEMOD)
+			val = demod.estimate((int)(pcm - pcmdata), thresholdLevel);
+		else
+			val = fast_fcnv(pcm, 1100, 2300, 1);
+		if (rawECG->push(val)) {
+			std::cerr << "Error! out of memory. (rawECG)\n";
+			return ERR_OTHER;
+		}
 	}
 
-	std::cout << "Data Length : " << idxECG << "\n";
+	std::cout << "Data Length : " << rawECG->size() << "\n";
 	return ERR_OK;
 }
 
@@ -378,17 +885,29 @@ int Convert2ECG::convetECGData(void)
 	int err = ERR_OK;
 
 	if (optDataOnly == 0.0) {
-		err = detectHeader();
+		timer.start(StageTimer::StageHeader);
+		if (header.endTime >= 0.0) {
+			currentPCMTime = header.endTime;	// found by selectChannel.
+			headerRetries = header.retries;
+			reportHeader();
+		}
+		else
+			err = detectHeader();
+		timer.stop(StageTimer::StageHeader);
 		if (err != ERR_OK) {
 			std::cerr << "Error! canot detect the header part.\n";
 			return err;
 		}
+		timer.start(StageTimer::StageCalibration);
 		err = analyzeCalibration();
+		timer.stop(StageTimer::StageCalibration);
 		if (err != ERR_OK && !optThroughCalibration) {
 			std::cerr << "Error! canot detect the calibration part.\n";
 			return err;
 		}
+		timer.start(StageTimer::StageSerialNo);
 		err = analyzeSerialNo();
+		timer.stop(StageTimer::StageSerialNo);
 		if (err != ERR_OK && optSerialNo == 0) {
 			std::cerr << "Error! canot detect the serial_NO part.\n";
 			return err;
@@ -400,15 +919,38 @@ int Convert2ECG::convetECGData(void)
 		}
 		serialNo = optSerialNo;
 	}
+	timer.start(StageTimer::StageData);
 	err = collectData();
+	timer.stop(StageTimer::StageData);
 	return err;
 }
 
 float *Convert2ECG::getCurrentPcmp(void)
 {
-	if (currentPCMTime >= durationPCMTime)
+	return getPcmp(currentPCMTime);
+}
+
+float *Convert2ECG::getPcmp(double pcmTime)
+{
+	int pcmidx = samplingRateI/2 + (int)(pcmTime*samplingRateF);
+
+	if (stream) {
+		float *pcm;
+		if (streamError || stream->window(pcmidx, &pcm) < 0) {
+			streamError = true;				// not the end of the data. (pcm2ecg fails)
+			return 0;
+		}
+		if (!stream->isEnded())
+			return pcm;
+		durationPCMTime = stream->getSamples()/samplingRateF;	// known at the end.
+		if (pcmTime >= durationPCMTime)
+			return 0;
+		return pcm;
+	}
+
+	if (pcmTime >= durationPCMTime)
 		return 0;
-	return &pcmdata[samplingRateI/2 + (int)(currentPCMTime*samplingRateF)];
+	return &pcmdata[pcmidx];
 }
 
 
@@ -428,22 +970,69 @@ int Convert2ECG::collectData(void)
     float* pcm;
     
 	int anchorIdx = 0;
+	int validCount = 0;
+	int validDiff = 0;
+	int validMax = 0;
     currentPCMTime += 1.0/kDataRate / 2.0;
 	if (optDataOnly > 0.0)
 		currentPCMTime = optDataOnly;
 
-	while ( idxECG < MaxECG &&
-           errorCounter < errorLimit && totalErrors < kTotalErrLimit) {
-        if ((pcm = getCurrentPcmp()) == 0) break;
-		
-        f = fast_fcnv(pcm, 1000, 2280, 1);
+	if (optEngine == ENGINE_SLIDING) {
+		if (slider.setup(pcmdata, pcmLength, samplingRateF, 1000, 2280, 40, GaborSigma, tblLevel)) {
+			std::cerr << "Error! cannot setup sliding engine.\n";
+			return ERR_OTHER;
+		}
+	}
+	else if (optEngine == ENGINE_DEMOD) {
+		if (demod.setup(pcmdata, pcmLength, samplingRateF, tbl_minf, tbl_maxf, GaborSigma, tblLevel)) {
+			std::cerr << "Error! cannot setup demod engine.\n";
+			return ERR_OTHER;
+		}
+	}
+
+	// Gabor estimates are independent: computed for a block on the worker
+	// threads, the error / anchor check below stays serial.
+	float *blockPcm[DataBlockSize];
+	int blockF[DataBlockSize];
+	bool gaborEngine = (optEngine == ENGINE_GABOR || optEngine == ENGINE_FIXED);
+	int blockSize = (gaborEngine && !stream && optThreads > 1) ? DataBlockSize : 1;
+	int blockLen = 0;
+	int blockIdx = 0;
+	trackIndex = 0;
+	trackPrevF = -1;
+
+	while ( errorCounter < errorLimit && totalErrors < kTotalErrLimit) {
+		if (blockIdx == blockLen) {
+			double t = currentPCMTime;
+			blockLen = 0;
+			blockIdx = 0;
+			while (blockLen < blockSize &&
+				   (blockPcm[blockLen] = getPcmp(t)) != 0) {
+				t += 1.0/kDataRate;
+				blockLen++;
+			}
+			if (blockLen == 0) break;
+			estimateData(blockPcm, blockF, blockLen);
+		}
+		pcm = blockPcm[blockIdx];
+		f = blockF[blockIdx++];
+
+		if ((optEngine != ENGINE_GABOR || optTrack) && optDebug) {		// validate against the full Gabor search.
+			bool fixed = fixedKernel;
+			fixedKernel = false;			// float kernel. (no worker runs here)
+			int d = abs(fast_fcnv(pcm, 1000, 2280, 1) - f);
+			fixedKernel = fixed;
+			validDiff += d;
+			if (d > validMax) validMax = d;
+			validCount++;
+		}
         
         currentPCMTime += 1.0/kDataRate;  // Data Rate
 		duratinTime += 1.0/kDataRate; 
                
         if ( 1180 <= f && f <= 2220) {
             errorCounter = 0;
-			anchorIdx = idxECG;
+			anchorIdx = rawECG->size();
         }
         else {
             errorCounter++;
@@ -451,21 +1040,163 @@ int Convert2ECG::collectData(void)
             if ( f > 2300 ) f = 2300;
         }
 
-        rawECG[idxECG++] = f;
+        if (rawECG->push(f)) {
+			std::cerr << "Error! out of memory. (rawECG)\n";
+			return ERR_OTHER;
+		}
     }
     
-	idxECG = anchorIdx;
+	rawECG->truncate(anchorIdx);
     if (optVerbose) {
 		std::cout << "\n- - - - - - - - - - - -\n";
 		std::cout << "Data Part.\n";
 		std::cout << "\tstartTime : " << dataStartTime << " sec\n";
 		std::cout << "\tduration  : " << duratinTime << " sec\n";
 		std::cout << "\terrors    : " << errorCounter << "\n";
-		std::cout << "\tsamples   : " << idxECG << "\n";
+		std::cout << "\tsamples   : " << rawECG->size() << "\n";
+		if (validCount > 0) {
+			std::cout << "\tengine diff: " << (double)validDiff/validCount << " Hz (max " << validMax << " Hz)\n";
+		}
 	}  
     return err;
 }
 
+/*
+ Frequency of the data samples at pcm[0..count).
+ */
+void Convert2ECG::estimateData(float *pcm[], int f[], int count)
+{
+	if (optEngine == ENGINE_SLIDING) {
+		for (int i=0; i<count; i++)
+			f[i] = slider.estimate((int)(pcm[i] - pcmdata), thresholdLevel);
+		return;
+	}
+	if (optEngine == ENGINE_DEMOD) {
+		for (int i=0; i<count; i++)
+			f[i] = demod.estimate((int)(pcm[i] - pcmdata), thresholdLevel);
+		return;
+	}
+	estimateParallel(pcm, f, count, optTrack ? ProbeTrack : ProbeData);
+	trackIndex += count;
+	trackPrevF = f[count-1];
+}
+
+/*
+ Run the probe for pcm[0..count) on optThreads threads.
+ */
+void Convert2ECG::estimateParallel(float *pcm[], int f[], int count, int probe)
+{
+	int threads = (optThreads < count) ? optThreads : count;
+	bool memoUsed = memoActive;
+	if (threads > 1)
+		memoActive = false;				// the memo is not shared by the workers.
+	std::vector<estimateJob> jobs((threads > 1) ? threads : 1);
+	for (size_t t=0; t<jobs.size(); t++) {
+		jobs[t].pcm = pcm;
+		jobs[t].f = f;
+		jobs[t].count = count;
+		jobs[t].first = (int)t;
+		jobs[t].step = (int)jobs.size();
+		jobs[t].probe = probe;
+	}
+	std::vector<std::thread> workers;
+	for (size_t t=1; t<jobs.size(); t++)
+		workers.push_back(std::thread(&Convert2ECG::estimateRange, this, &jobs[t]));
+	estimateRange(&jobs[0]);
+	for (size_t t=0; t<workers.size(); t++)
+		workers[t].join();
+	memoActive = memoUsed;
+}
+
+void Convert2ECG::estimateRange(estimateJob *job)
+{
+	float **pcm = job->pcm;
+	int *f = job->f;
+	int count = job->count;
+	int first = job->first;
+	int step = job->step;
+	int probe = job->probe;
+
+	if (probe == ProbeTrack) {
+		// a run depends on its previous samples: the runs go to the threads.
+		int run = -1;
+		for (int i=0; i<count; i++) {
+			int n = trackIndex + i;
+			if (i == 0 || n % TrackRunLength == 0)
+				run++;
+			if (run % step != first)
+				continue;
+			int prevF = (i == 0) ? trackPrevF : f[i-1];
+			f[i] = -1;
+			if (n % TrackRunLength != 0 && prevF >= 0) {
+				f[i] = track_fcnv(pcm[i], prevF, 1000, 2280);
+				if (f[i] >= 0)
+					trackHits++;
+				else
+					trackFallbacks++;
+			}
+			if (f[i] < 0)
+				f[i] = fast_fcnv(pcm[i], 1000, 2280, 1);
+		}
+		return;
+	}
+	for (int i=first; i<count; i+=step) {
+		if (probe == ProbeLeadIn)
+			f[i] = fvconvert(pcm[i], 1180, 1320, 10);		// same as DetectingHeader.
+		else
+			f[i] = fast_fcnv(pcm[i], 1000, 2280, 1);
+	}
+}
+
+/*
+ Search the header lead-in (1200Hz) from startTime in parallel.
+ The probes of a 1mSec grid are computed on the worker threads, then the
+ grid is walked with the steps of DetectingHeader (1mSec below 1195Hz,
+ 2mSec otherwise). Returns the time of the first sweep candidate, which
+ DetectingHeader confirms, or the end of the data.
+ */
+double Convert2ECG::searchLeadIn(double startTime)
+{
+	const int searchBlock = 256;				// max grid points per thread and round.
+	std::vector<float *> pcm;
+	std::vector<double> times;
+	std::vector<int> f;
+	double t = startTime;
+	int block = 8;								// small first: a candidate is often near.
+
+	for (;;) {
+		int gridLen = block * optThreads;
+		if (block < searchBlock)
+			block *= 2;
+		double g = t;
+		float *p;
+		pcm.clear();
+		times.clear();
+		while ((int)pcm.size() < gridLen && (p = getPcmp(g)) != 0) {
+			pcm.push_back(p);
+			times.push_back(g);
+			g += k1mSecond;
+		}
+		if (pcm.empty())
+			return t;							// end of data.
+
+		f.resize(pcm.size());
+		estimateParallel(&pcm[0], &f[0], (int)pcm.size(), ProbeLeadIn);
+
+		size_t k = 0;
+		while (k < pcm.size()) {
+			if (f[k] < 1195) {
+				k++;
+				continue;
+			}
+			if (f[k] > 1205 && f[k] < 1280)
+				return times[k];
+			k += 2;
+		}
+		t = g + (k - pcm.size()) * k1mSecond;
+	}
+}
+
 #define printf(...)			// debug...
 
 /*
@@ -496,10 +1227,16 @@ int Convert2ECG::detectHeader(void)
     int phase = DetectingHeader;
     int adjustOffset = 0;
     float* pcm;
+	const bool parallelSearch = (optThreads > 1 && !stream);
+	bool searchAhead = parallelSearch;
 
 	currentPCMTime = 0.0;
     BOOL done = FALSE;
     while (!done) {
+		if (phase == DetectingHeader && searchAhead) {
+			currentPCMTime = searchLeadIn(currentPCMTime);
+			searchAhead = false;
+		}
         if ((pcm = getCurrentPcmp()) == 0) {
 			std::cerr << "Error! cannot detect header part. proc time:" << currentPCMTime << "\n";
 			return ERR_STOP_EMPTY;		// no data.
@@ -545,6 +1282,8 @@ int Convert2ECG::detectHeader(void)
 		                printf(" Header! out of range f:%d t:%.4f\n", f, currentPCMTime);
                     
 			            phase = DetectingHeader;	// LeedČo
+						searchAhead = parallelSearch;
+						headerRetries++;
 				        break;
 					}
 					else {
@@ -592,6 +1331,8 @@ int Convert2ECG::detectHeader(void)
                     printf("OVER ERROR Retry Header lead... f:%d t:%.4f err:%d dero:%d\n", f, currentPCMTime, errorCounter, derogation);
                     phase = DetectingHeader;	// LeedČo
 					currentPCMTime = sweepStartTime;		// 2015/12/22
+					searchAhead = parallelSearch;
+					headerRetries++;
                 }
                 
                 currentPCMTime += bitUTimeSweep * k1mSecond;
@@ -604,16 +1345,27 @@ int Convert2ECG::detectHeader(void)
         }
     }
     
+	header.endTime = currentPCMTime;
+	header.startTime = sweepStartTime;
+	header.duration = duratinTime;
+	header.errors = errorCounter;
+	header.derogation = derogation;
+	header.retries = headerRetries;
+	reportHeader();
+
+    return ERR_OK;
+}
+
+void Convert2ECG::reportHeader(void)
+{
 	if (optVerbose) {
 		std::cout << "\n- - - - - - - - - - - -\n";
 		std::cout << "Header Part.\n";
-		std::cout << "\tstartTime : " << sweepStartTime << " sec\n";
-		std::cout << "\tduration  : " << duratinTime << " msec\n";
-		std::cout << "\terrors    : " << errorCounter << "\n";
-		std::cout << "\tderogation: " << derogation << "\n";
+		std::cout << "\tstartTime : " << header.startTime << " sec\n";
+		std::cout << "\tduration  : " << header.duration << " msec\n";
+		std::cout << "\terrors    : " << header.errors << "\n";
+		std::cout << "\tderogation: " << header.derogation << "\n";
 	}
-
-    return ERR_OK;
 }
 
 /*
@@ -933,6 +1685,27 @@ int Convert2ECG::fast_fcnv(float pcm[],							// 
     return f;
 }
 
+/*
+ Data sample near the previous one. (-T) the FM of the ECG moves slowly,
+ so the peak is searched in prevF +-TrackWindow at 1Hz. On the edge of the
+ window (not of minF - maxF) it is searched again around the edge with
+ twice the width, up to TrackMaxWindow. -1: no peak over thresholdLevel or
+ still on the edge, fast_fcnv searches the whole range.
+ */
+int Convert2ECG::track_fcnv(float pcm[], int prevF, int minF, int maxF)
+{
+    for (int width = TrackWindow; width <= TrackMaxWindow; width *= 2) {
+        int lo = (prevF - width > minF) ? prevF - width : minF;
+        int hi = (prevF + width < maxF) ? prevF + width : maxF;
+        int f = fvconvert(pcm, lo, hi + 1, 1);
+        if (f < 0)
+            return f;
+        if ((f > lo || lo == minF) && (f < hi || hi == maxF))
+            return f;
+        prevF = f;
+    }
+    return -1;
+}
 
 int Convert2ECG::fvconvert(float pcm[],             // ׂPCM̒f[^|WV
               int minF, int maxF, int pitch)		// ͎gAAAԊu
@@ -942,7 +1715,14 @@ int Convert2ECG::fvconvert(float pcm[],             // 
     float peek;
     int i, peek_idx;
     
+    if (gate.isDead(pcm)) {
+        gaborGated++;
+        return -1;				// no peak can reach thresholdLevel.
+    }
+
     int wt_len = (maxF-minF)/pitch;
+    gaborCalls++;
+    gaborRows += wt_len;
 	gabor_transform(pcm, minF, pitch, wt, wt_len);
     
     peek = thresholdLevel;
@@ -969,8 +1749,9 @@ int Convert2ECG::fvconvert(float pcm[],             // 
 
 void Convert2ECG::gabor_transform(float pcm[], int baseF, int stepF, float wt[], int wt_len)
 {
-    int y, m;
+    int y;
     
+    int index = memoActive ? (int)(pcm - pcmdata) : -1;
     for (y = 0; y < wt_len; y++)
     {
         int freq = baseF + stepF*y;
@@ -978,21 +1759,19 @@ void Convert2ECG::gabor_transform(float pcm[], int baseF, int stepF, float wt[],
             wt[y] = 0.0;				// Out of Range.
             continue;
         }
+        if (index >= 0 && memo.find(index, freq, &wt[y]))
+            continue;
         
-        int dx = gtbl->dxlen[freq - tbl_minf];
-        float real_wt = 0;
-        float imag_wt = 0;
-        
-        float* gf = &gtbl->tbl[gtbl->offset[freq - tbl_minf]];
-        float* pcmp = &pcm[-dx];
+        float real_wt;
+        float imag_wt;
         
-        for (m = -dx; m <= dx; m++)
-        {
-            float pcmd = *pcmp++;
-            real_wt += pcmd * *gf++;
-            imag_wt += pcmd * *gf++;
-        }
+        if (fixedKernel)
+            gkernel16->transform(&pcm16[pcm - pcmdata], freq - tbl_minf, &real_wt, &imag_wt);
+        else
+            gkernel->transform(pcm, freq - tbl_minf, &real_wt, &imag_wt);
         wt[y] = (float)(freq)*sqrtf(1.0F/(float)(freq)) * sqrtf(real_wt*real_wt + imag_wt*imag_wt);
+        if (index >= 0)
+            memo.put(index, freq, wt[y]);
     }
 }
 
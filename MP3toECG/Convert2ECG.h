@@ -1,22 +1,49 @@
 #pragma once
 #include <atltime.h>
+#include <atomic>
 #include "Arguments.h"
+#include "Decimator.h"
+#include "ECGBuffer.h"
+#include "SlidingGabor.h"
+#include "FMDemod.h"
+#include "GaborMemo.h"
+#include "GaborKernel.h"
+#include "GaborTableSet.h"
+#include "OutputFile.h"
+#include "PcmStream.h"
+#include "SignalGate.h"
+#include "StageTimer.h"
+#include "WavFile.h"
 
 static const char *tblFilePath441 = "GFactorTable441.dat";
 static const char *tblFilePath480 = "GFactorTable480.dat";
+static const char *tblImagePath441 = "GFactorTable441.gtb";
+static const char *tblImagePath480 = "GFactorTable480.gtb";
+static const char *tblImageName = "GFactorTable";	// + rate + ".gtb" (generated table)
 static const int tbl_minf = 1000;
 static const int tbl_maxf = 2400;
 static const int tbl_size = (tbl_maxf-tbl_minf);
 const int SamplingRate441 = 44100;
 const int SamplingRate480 = 48000;
+const int MinSamplingRate = 8000;			// Nyquist must exceed tbl_maxf.
+const int MaxSamplingRate = 192000;
 //const int DataRate = 450;
 const int DataRate = 2000;
 const double k1mSecond = 1.0/1000.0;
 const float	thresholdLevel = 4.0;
+const float	GaborSigma = 2.0;			// sigma of G-Table gaussian.
+const double StreamHistoryTime = 1.0;	// sec, kept behind the position. (stream input)
+const int MaxChannels = 8;				// channels of the selection. (more: down mix only)
+const double ChannelLockTolerance = 0.02;	// sec, header locks taken as the same time.
+const float ChannelScoreMargin = 1.2F;		// a channel replaces the down mix when this much better.
+const double ChannelProbeTime = 20.0;		// sec, first part of the channels probed. (doubled until a lock)
+const int TrackWindow = 6;				// Hz, first search window around the previous sample. (-T)
+const int TrackMaxWindow = 48;			// Hz, wider: the full search.
+const int TrackRunLength = 45;			// data samples from one full search. (DataBlockSize / n)
 
 
-const int MaxECGTable = 150000;
-const int MaxECG = 7200;
+const int DataBlockSize = 450;				// data samples per parallel block. (1 sec)
+const int offsetECGValue = 1700;			// .ecg value = offsetECGValue - frequency.
 
 #pragma warning(disable : 4200)
 struct gaborFactorTbl {
@@ -28,8 +55,15 @@ struct gaborFactorTbl {
 
 class Convert2ECG
 {
+	friend class GaborBench;				// microbenchmark. (GaborBench project)
+
 private:
-	gaborFactorTbl *gtbl;
+	enum {
+		ProbeData,							// fast_fcnv 1000-2280Hz (data section)
+		ProbeLeadIn,						// fvconvert 1180-1320Hz (header lead-in)
+		ProbeTrack,							// track_fcnv, fast_fcnv at the run start. (-T)
+	};
+
 	bool	optVerbose;
 	bool	optWholedata;
 	bool	optRaw;
@@ -37,38 +71,111 @@ private:
 	int		optSerialNo;
 	double	optDataOnly;
 	bool	optDebug;
+	int		optEngine;
+	int		optThreads;						// data section worker threads.
+	bool	optTrack;						// data section frequency tracking.
 	CTime	procTime;
 	
 
 	int		samplingRateI;
 	float	samplingRateF;
+	float	tblLevel;						// G-Table factor scale. (generated table)
 
 	float	*pcmdata;
+	float	*channelData[MaxChannels];	// each channel, same layout as pcmdata. (multi-channel MP3)
+	WavFile	sound;							// WAV input, open until the channel is selected.
+	int		channels;						// of the input.
+	int		selectedChannel;				// 0: down mix, 1..: channel, -1: difference (stereo)
+	__int16	*pcm16;							// 16 bit copy of pcmdata. (-e int16)
+	PcmStream *stream;						// stream input. (-p)
+	bool	streamError;					// out of the history or read error. (-p)
+	int		pcmLength;
 	double	durationPCMTime;
 	double	currentPCMTime;
 
-	int		rawECG[MaxECGTable];
-	int		idxECG;
+	ECGBuffer ownECG;
+	ECGBuffer *rawECG;						// data samples. (ownECG or lent by shareECGBuffer)
 	int		serialNo;
 	int		serialSum;
 	int		checkSum;
 
+	StageTimer timer;
+	int		headerRetries;					// detectHeader back to the lead-in.
+	struct headerResult {
+		double	endTime;					// currentPCMTime after the header. (-1: not detected)
+		double	startTime;
+		int		duration;					// msec
+		int		errors;
+		int		derogation;
+		int		retries;
+	};
+	headerResult header;					// of detectHeader, or of the selected channel probe.
+	struct channelProbe {					// probeHeader of a candidate. (selectChannel)
+		float	*pcm;
+		int		length;
+		double	duration;
+		headerResult result;
+		float	score;
+	};
+	struct estimateJob {					// estimateRange of a thread. (VS2012 std::thread: 5 arguments)
+		float	**pcm;
+		int		*f;
+		int		count;
+		int		first;
+		int		step;
+		int		probe;
+	};
+	std::atomic<long long> gaborCalls;		// fvconvert transforms. (all threads)
+	std::atomic<long long> gaborRows;		// frequency rows of the transforms.
+	std::atomic<long long> gaborGated;		// fvconvert skipped by the gate.
+	std::atomic<long long> trackHits;		// data samples found in the track window.
+	std::atomic<long long> trackFallbacks;	// tracked, but searched in the whole range.
+	int		trackIndex;						// data sample number of the next estimateData.
+	int		trackPrevF;						// frequency of the sample before it.
+
+	SlidingGabor slider;
+	FMDemod	demod;
+	GaborTableSet ownTables;
+	GaborTableSet *tables;
+	GaborKernel	*gkernel;
+	GaborKernel16 *gkernel16;
+	bool	fixedKernel;					// gabor_transform by gkernel16.
+	SignalGate gate;
+	GaborMemo memo;
+	bool	memoActive;						// gabor_transform reads / fills memo.
+
 private:
 	int setupGTable( int samplingrate, std::string currentPath );
+	int setupFixedKernel(void);
 	int loadSoundData( const char* soundf );
+	int readSoundData(void);
+	int decimatePcm(void);
+	int selectChannel(std::string currentPath);
+	void probeHeader(channelProbe *candidate);
+	void releaseChannels(void);
 	int pcm2ecg( void );
 	int covertWholeData(void);
 	int convetECGData(void);
 	float *Convert2ECG::getCurrentPcmp();
+	float *getPcmp(double pcmTime);
 	int detectHeader(void);
+	void reportHeader(void);
 	int analyzeCalibration(void);
 	int analyzeSerialNo(void);
 	int collectData(void);
+	void estimateData(float *pcm[], int f[], int count);
+	void estimateParallel(float *pcm[], int f[], int count, int probe);
+	void estimateRange(estimateJob *job);
+	double searchLeadIn(double startTime);
+	void putECGHeader(OutputFile &out);
 	void outECGRaw(char *fpath);
 	void outECG(char *fpath);
+	void outECGBinary(char *fpath);
+	void outReport(Arguments arg, int status, double total);
 	void gabor_transform(float pcm[], int baseF, int stepF, float wt[], int wt_len);
 	int fvconvert(float pcm[], int minF, int maxF, int pitch);
 	int fast_fcnv(float pcm[], int minF, int maxF, int pitch);
+	int track_fcnv(float pcm[], int prevF, int minF, int maxF);
 
 	void fconvTest( void );
 	void maketabl(void);
@@ -76,7 +183,15 @@ private:
 public:
 	Convert2ECG(void);
 	virtual ~Convert2ECG(void);
+	void shareTables(GaborTableSet *set);
+	void shareECGBuffer(ECGBuffer *buf);
+	int decodeMp3(Arguments arg);
+	int setSoundData(const char *wav, int size);
+	int openStream(Arguments arg);
 	int convert(Arguments arg);
 	void outStatus(Arguments arg, int status);
+	void startStage(int stage);				// StageTimer::StageXXX
+	void stopStage(int stage);
+	int getSerialNo(void) { return serialNo; }
 };
 
@@ -0,0 +1,305 @@
+#include "stdafx.h"
+#include "ConvertServer.h"
+#include "Convert2ECG.h"
+#include "ErrorStatusNo.h"
+#include "ResultCache.h"
+
+#include <iostream>
+#include <locale.h>
+#include <sstream>
+#include <string.h>
+#include <thread>
+
+ConvertServer::ConvertServer(void)
+{
+	sessions = 0;
+}
+
+ConvertServer::~ConvertServer(void)
+{
+}
+
+/*
+ Wait for the clients. returns only on error.
+ */
+int ConvertServer::run(Arguments &arg)
+{
+	baseArg = arg;
+	tables.init(baseArg.currentPath, baseArg.opt_v, baseArg.opt_X);
+
+	// set up the usual tables before the first job.
+	float level;
+	if (!tables.get(SamplingRate441, &level) || !tables.get(SamplingRate480, &level)) {
+		std::cerr << "Error! cannot load G-Table.\n";
+		return -1;
+	}
+
+	// connections served at once. (same as the batch workers)
+	int maxSessions = baseArg.jobs;
+	if (maxSessions <= 0)
+		maxSessions = (int)std::thread::hardware_concurrency();
+	if (maxSessions <= 0)
+		maxSessions = 1;
+
+	std::string name = baseArg.getPipeName();
+	std::cout << "Server: " << name << " (" << maxSessions << " connections)\n";
+	DWORD firstInstance = FILE_FLAG_FIRST_PIPE_INSTANCE;	// not a pipe of another server.
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> guard(sessionLock);
+			while (sessions >= maxSessions)
+				sessionEnd.wait(guard);
+		}
+		HANDLE pipe = CreateNamedPipeA(name.c_str(), PIPE_ACCESS_DUPLEX | firstInstance,
+			PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, PIPE_UNLIMITED_INSTANCES,
+			kPipeBuffer, kPipeBuffer, 0, NULL);
+		if (pipe == INVALID_HANDLE_VALUE) {
+			if (firstInstance && GetLastError() == ERROR_ACCESS_DENIED)
+				std::cerr << "Error! pipe is used by another process:" << name << "\n";
+			else
+				std::cerr << "Error! cannot create pipe:" << name << "\n";
+			return -1;
+		}
+		firstInstance = 0;
+		if (ConnectNamedPipe(pipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED) {
+			std::lock_guard<std::mutex> guard(sessionLock);
+			sessions++;
+			std::thread(&ConvertServer::session, this, pipe).detach();
+		}
+		else
+			CloseHandle(pipe);
+	}
+}
+
+/*
+ One client connection.
+ */
+void ConvertServer::session(HANDLE pipe)
+{
+#ifdef _MSC_VER
+	// outStatus / outECG call setlocale().
+	_configthreadlocale(_ENABLE_PER_THREAD_LOCALE);
+#endif
+	connection conn;
+	conn.pipe = pipe;
+	conn.closing = false;
+
+	std::string line;
+	while (!conn.closing && readLine(conn, line)) {
+		if (line.compare("QUIT") == 0)
+			break;
+		if (line.empty())
+			continue;
+		if (!writeText(pipe, runJob(conn, line) + "\n"))
+			break;
+	}
+
+	FlushFileBuffers(pipe);
+	DisconnectNamedPipe(pipe);
+	CloseHandle(pipe);
+
+	std::lock_guard<std::mutex> guard(sessionLock);
+	sessions--;
+	sessionEnd.notify_one();
+}
+
+std::string ConvertServer::runJob(connection &conn, const std::string &line)
+{
+	std::vector<std::string> args;
+	splitArgs(line, args);
+	if (args.empty())
+		return "status=-1\terror=empty request";
+	std::string cmd = args[0];
+	args.erase(args.begin());
+
+	std::vector<char> wav;
+	if (cmd.compare("PCM") == 0) {
+		int bytes = args.empty() ? 0 : atoi(args[0].c_str());
+		if (bytes <= 0 || bytes > kMaxPcmBytes) {
+			conn.closing = true;
+			return "status=-1\terror=wrong PCM size";
+		}
+		args.erase(args.begin());
+		if (!readBytes(conn, wav, bytes)) {
+			conn.closing = true;
+			return "status=-1\terror=PCM data is short";
+		}
+	}
+	else if (cmd.compare("CONVERT") != 0) {
+		return "status=-1\terror=unknown command:" + cmd;
+	}
+
+	Arguments argument = baseArg;
+	if (argument.parseJobArgs(args))
+		return "status=-1\terror=wrong options";
+	if (argument.threads == 0)
+		argument.threads = 1;				// the clients are already in parallel.
+
+	int serialNo = 0;
+	std::string error;
+	int status = convertJob(conn, argument, wav.empty() ? NULL : &wav, &serialNo, &error);
+	if (!error.empty()) {
+		std::ostringstream reply;
+		reply << "status=" << status << "\terror=" << error;
+		return reply.str();						// no output files.
+	}
+
+	char ecgPath[_MAX_PATH];
+	char rstPath[_MAX_PATH];
+	if (argument.opt_B)
+		argument.getBinaryPath(ecgPath, sizeof(ecgPath));
+	else
+		argument.getEcgFilePath(ecgPath, sizeof(ecgPath));
+	argument.getStatusPath(rstPath, sizeof(rstPath));
+
+	std::ostringstream reply;
+	reply << "status=" << status << "\tserialNo=" << serialNo
+		  << "\tecg=" << ecgPath << "\trst=" << rstPath;
+	return reply.str();
+}
+
+/*
+ Same steps as BatchConverter::convertFile, the input is the mp3 file or
+ the WAV bytes of the request. error: set when the input was not read and
+ no output is written.
+ */
+int ConvertServer::convertJob(connection &conn, Arguments &argument, const std::vector<char> *wav, int *serialNo, std::string *error)
+{
+	char path[_MAX_PATH];
+	argument.getMp3FilePath(path, sizeof(path));
+
+	ResultCache cache;
+	int opened = wav ? cache.open(argument, &(*wav)[0], wav->size()) : cache.open(argument);
+	if (opened == 0) {
+		int status;
+		if (cache.fetch(argument, &status, serialNo) == 0) {
+			std::lock_guard<std::mutex> guard(outLock);
+			std::cout << path << "\tstatus:" << status << "\tcached" << std::endl;
+			return status;
+		}
+	}
+
+	Convert2ECG converter;
+	converter.shareTables(&tables);
+	converter.shareECGBuffer(&conn.ecg);
+
+	int status = -1;
+	if (wav) {
+		converter.startStage(StageTimer::StageLoad);
+		status = converter.setSoundData(&(*wav)[0], (int)wav->size());
+		converter.stopStage(StageTimer::StageLoad);
+		if (status != ERR_OK) {
+			*error = "cannot read PCM data";
+			std::lock_guard<std::mutex> guard(outLock);
+			std::cout << path << "\tstatus:" << status << std::endl;
+			return status;
+		}
+	}
+	else if (argument.isWaveInput())
+		status = ERR_OK;						// read in place by convert.
+	else {
+		if (!argument.opt_f)
+			status = converter.decodeMp3(argument);
+		if (status != ERR_OK) {
+			converter.startStage(StageTimer::StageFfmpeg);
+			status = argument.convertToWave();		// use ffmpeg.
+			converter.stopStage(StageTimer::StageFfmpeg);
+			if (status != ERR_OK) {
+				std::lock_guard<std::mutex> guard(outLock);
+				std::cerr << "Error Internal cannot convert MP3 to WAV:" << path << "\n";
+				*error = "cannot convert MP3 to WAV";
+				return -1;
+			}
+		}
+	}
+
+	if (status == ERR_OK) {
+		status = converter.convert(argument);
+		converter.outStatus(argument, status);
+		*serialNo = converter.getSerialNo();
+		cache.store(argument, status, *serialNo);
+	}
+	if (!wav)
+		argument.delteWaveFile();
+
+	std::lock_guard<std::mutex> guard(outLock);
+	std::cout << path << "\tstatus:" << status << std::endl;		// resident, flush per job.
+	return status;
+}
+
+bool ConvertServer::readLine(connection &conn, std::string &line)
+{
+	for (;;) {
+		size_t pos = conn.pending.find('\n');
+		if (pos != std::string::npos) {
+			line = conn.pending.substr(0, pos);
+			conn.pending.erase(0, pos + 1);
+			if (!line.empty() && line[line.length()-1] == '\r')
+				line.erase(line.length()-1);
+			return true;
+		}
+		char buf[4096];
+		DWORD got = 0;
+		if (!ReadFile(conn.pipe, buf, sizeof(buf), &got, NULL) || got == 0)
+			return false;
+		conn.pending.append(buf, got);
+	}
+}
+
+bool ConvertServer::readBytes(connection &conn, std::vector<char> &data, int count)
+{
+	data.resize(count);
+	int have = (int)conn.pending.size();
+	if (have > count)
+		have = count;
+	memcpy(&data[0], conn.pending.data(), have);
+	conn.pending.erase(0, have);
+
+	while (have < count) {
+		DWORD want = (count - have < kPipeBuffer) ? count - have : kPipeBuffer;
+		DWORD got = 0;
+		if (!ReadFile(conn.pipe, &data[have], want, &got, NULL) || got == 0)
+			return false;
+		have += got;
+	}
+	return true;
+}
+
+bool ConvertServer::writeText(HANDLE pipe, const std::string &text)
+{
+	size_t done = 0;
+	while (done < text.length()) {
+		DWORD put = 0;
+		if (!WriteFile(pipe, text.data() + done, (DWORD)(text.length() - done), &put, NULL) || put == 0)
+			return false;
+		done += put;
+	}
+	return true;
+}
+
+/*
+ Split at the spaces, "..." is one argument.
+ */
+void ConvertServer::splitArgs(const std::string &line, std::vector<std::string> &args)
+{
+	size_t idx = 0;
+	while (idx < line.length()) {
+		while (idx < line.length() && (line[idx] == ' ' || line[idx] == '\t'))
+			idx++;
+		if (idx >= line.length())
+			break;
+
+		std::string arg;
+		bool quoted = false;
+		for (; idx < line.length(); idx++) {
+			char c = line[idx];
+			if (c == '"')
+				quoted = !quoted;
+			else if (!quoted && (c == ' ' || c == '\t'))
+				break;
+			else
+				arg += c;
+		}
+		args.push_back(arg);
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <Windows.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Arguments.h"
+#include "ECGBuffer.h"
+#include "GaborTableSet.h"
+
+/*
+ Server mode. (-S pipeName)
+
+ The process stays resident: the configuration is parsed and the G-Tables of
+ 44.1/48KHz are set up once, then conversion jobs are accepted on a named
+ pipe. Every client connection is served by its own thread, so the jobs of
+ concurrent clients run in parallel, up to -j connections (CPU count) as
+ the batch workers; more clients wait for a free pipe instance. A
+ connection can send any number of jobs, one request line each, and gets
+ one reply line per job. A second server on the same pipe name fails.
+
+   CONVERT [-c] [-r] [-w] [-s serialNo] [-d startTime] mp3File
+   PCM bytes [-c] [-r] [-w] [-s serialNo] [-d startTime] name
+       followed by 'bytes' bytes of a WAV file (16/24/32bit linear PCM or
+       32bit float), the output files are named after 'name'.
+   QUIT
+
+   Paths with spaces are put in double quotes.
+
+   reply: status=0<TAB>serialNo=10018<TAB>ecg=path<TAB>rst=path
+          status=-1<TAB>error=message		(the request is wrong, or no
+                                        output: PCM data or mp3 not read)
+   A wrong PCM size closes the connection, the following bytes are not
+   known to be a request.
+ */
+class ConvertServer
+{
+private:
+	static const int kPipeBuffer = 64 * 1024;
+	static const int kMaxPcmBytes = 512 * 1024 * 1024;
+
+	// buffered reading of a connection.
+	struct connection {
+		HANDLE	pipe;
+		std::string	pending;
+		bool	closing;					// the stream is out of sync.
+		ECGBuffer	ecg;					// reused by the jobs of the connection.
+	};
+
+	Arguments	baseArg;
+	GaborTableSet tables;
+	std::mutex	outLock;
+	std::mutex	sessionLock;
+	std::condition_variable sessionEnd;
+	int		sessions;						// connections being served.
+
+	void session(HANDLE pipe);
+	std::string runJob(connection &conn, const std::string &line);
+	int convertJob(connection &conn, Arguments &argument, const std::vector<char> *wav, int *serialNo, std::string *error);
+	static bool readLine(connection &conn, std::string &line);
+	static bool readBytes(connection &conn, std::vector<char> &data, int count);
+	static bool writeText(HANDLE pipe, const std::string &text);
+	static void splitArgs(const std::string &line, std::vector<std::string> &args);
+
+public:
+	ConvertServer(void);
+	virtual ~ConvertServer(void);
+
+	int run(Arguments &arg);
+};
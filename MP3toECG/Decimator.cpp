@@ -0,0 +1,92 @@
+#include "stdafx.h"
+#include "Decimator.h"
+
+#include <emmintrin.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+Decimator::Decimator(void)
+{
+	factor = 1;
+	rate = 0;
+	taps = nullptr;
+	tapCount = 0;
+	padCount = 0;
+}
+
+Decimator::~Decimator(void)
+{
+	release();
+}
+
+void Decimator::release(void)
+{
+	if (taps)	free(taps);
+	taps = nullptr;
+	tapCount = 0;
+	padCount = 0;
+	factor = 1;
+}
+
+/*
+ Factor and low-pass for samplingRate. factor 1 if the rate cannot be
+ reduced. returns -1 if out of memory.
+ */
+int Decimator::setup(int samplingRate, int minRate, int maxF)
+{
+	release();
+	rate = samplingRate;
+
+	for (int d = samplingRate / minRate; d >= 2; d--) {
+		if (samplingRate % d == 0) {
+			factor = d;
+			break;
+		}
+	}
+	if (factor < 2)
+		return 0;
+	rate = samplingRate / factor;
+
+	// Blackman window: transition width 5.5 / taps (normalized frequency)
+	double transition = (double)(rate - 2*maxF) / samplingRate;
+	tapCount = (int)ceil(5.5 / transition) | 1;
+	padCount = (tapCount + 7) & ~7;
+	taps = (float *)malloc(padCount * sizeof(float));
+	if (!taps) {
+		release();
+		return -1;
+	}
+	memset(taps, 0, padCount * sizeof(float));
+
+	double cutoff = 0.5 / factor;			// new Nyquist. (normalized)
+	int half = tapCount/2;
+	double sum = 0.0;
+	for (int i=0; i<tapCount; i++) {
+		int n = i - half;
+		double sinc = (n == 0) ? 2.0*cutoff : sin(2.0*M_PI*cutoff*n) / (M_PI*n);
+		double w = 0.42 - 0.5*cos(2.0*M_PI*i/(tapCount-1)) + 0.08*cos(4.0*M_PI*i/(tapCount-1));
+		taps[i] = (float)(sinc * w);
+		sum += taps[i];
+	}
+	for (int i=0; i<tapCount; i++)
+		taps[i] = (float)(taps[i] / sum);	// unity gain.
+	return 0;
+}
+
+void Decimator::run(const float *src, float *dst, int count)
+{
+	int half = tapCount/2;
+	for (int k=0; k<count; k++) {
+		const float *p = &src[k*factor - half];
+		__m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+		for (int i=0; i<padCount; i+=8) {
+			a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(&p[i]),   _mm_loadu_ps(&taps[i])));
+			a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(&p[i+4]), _mm_loadu_ps(&taps[i+4])));
+		}
+		float sum[4];
+		_mm_storeu_ps(sum, _mm_add_ps(a0, a1));
+		dst[k] = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+	}
+}
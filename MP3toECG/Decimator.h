@@ -0,0 +1,38 @@
+#pragma once
+
+/*
+ Band limited decimation of the PCM. (-D)
+
+ The signal of interest is below tbl_maxf, so the PCM is low-passed and
+ reduced by an integer factor to the lowest rate not below minRate. The
+ low-pass is a linear phase FIR (windowed sinc, Blackman): cutoff at the new
+ Nyquist, the transition band from maxF to newRate - maxF, so nothing folds
+ back below maxF (about -74dB). Only the kept samples are filtered
+ (polyphase form). The window of the Gabor transform is fixed in seconds,
+ so at the lower rate every gabor_transform reads factor times fewer
+ samples and G-Table factors.
+ */
+class Decimator
+{
+private:
+	int		factor;
+	int		rate;							// after decimation.
+	float	*taps;							// [padCount] symmetric, zero padded.
+	int		tapCount;
+	int		padCount;						// multiple of 8. (SSE2 loop)
+
+	void release(void);
+
+public:
+	Decimator(void);
+	virtual ~Decimator(void);
+
+	int setup(int samplingRate, int minRate, int maxF);
+	int getFactor(void) { return factor; }
+	int getRate(void) { return rate; }
+	int getTaps(void) { return tapCount; }
+	int getReach(void) { return tapCount/2; }
+
+	// dst[k] = low-passed src[k * factor], src must be readable -getReach() .. +getReach()+8.
+	void run(const float *src, float *dst, int count);
+};
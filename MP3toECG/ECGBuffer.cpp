@@ -0,0 +1,27 @@
+#include "stdafx.h"
+#include "ECGBuffer.h"
+
+#include <stdlib.h>
+
+ECGBuffer::ECGBuffer(void)
+{
+	data = nullptr;
+	count = 0;
+	capacity = 0;
+}
+
+ECGBuffer::~ECGBuffer(void)
+{
+	if (data)	free(data);
+}
+
+int ECGBuffer::grow(void)
+{
+	int newCapacity = (capacity > 0) ? capacity * 2 : kInitialCapacity;
+	__int16 *p = (__int16 *)realloc(data, newCapacity * sizeof(__int16));
+	if (!p)
+		return -1;
+	data = p;
+	capacity = newCapacity;
+	return 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ ECG sample storage.
+
+ The samples are frequencies (1000 .. 2300Hz, -1 for no peak), so they are
+ kept as 16 bit. The buffer grows with the data and clear() keeps the
+ allocation, a buffer lent to Convert2ECG is reused by the next conversion.
+ */
+class ECGBuffer
+{
+private:
+	static const int kInitialCapacity = 8192;	// a 16 sec transmission. (450 samples/sec)
+
+	__int16	*data;
+	int		count;
+	int		capacity;
+
+	int grow(void);
+
+public:
+	ECGBuffer(void);
+	virtual ~ECGBuffer(void);
+
+	int push(int val) {
+		if (count >= capacity && grow())
+			return -1;
+		data[count++] = (__int16)val;
+		return 0;
+	}
+	void clear(void) { count = 0; }
+	void truncate(int length) { if (length < count) count = length; }
+	int size(void) const { return count; }
+	int operator[](int idx) const { return data[idx]; }
+};
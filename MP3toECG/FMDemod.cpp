@@ -0,0 +1,212 @@
+#include "stdafx.h"
+#include "FMDemod.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+FMDemod::FMDemod(void)
+{
+	samplingRate = 0.0F;
+	centerF = 0.0F;
+	minF = maxF = 0;
+	gain = 0.0F;
+	rotRe = 1.0;
+	rotIm = 0.0;
+	delay = settle = 0;
+	weight = nullptr;
+	halfWin = 0;
+	zRe = zIm = nullptr;
+	pcm = nullptr;
+	pcmLength = 0;
+	nextIdx = 0;
+}
+
+FMDemod::~FMDemod(void)
+{
+	release();
+}
+
+void FMDemod::release(void)
+{
+	if (weight)	free(weight);
+	if (zRe)	free(zRe);
+	if (zIm)	free(zIm);
+	weight = nullptr;
+	zRe = zIm = nullptr;
+	halfWin = 0;
+}
+
+/*
+ Demodulate the band minF .. maxF. sigma is the gaussian width in periods,
+ same as the G-Table (2.0). level is the factor scale of the G-Table in use.
+ */
+int FMDemod::setup(const float *pcmp, int length, float rate,
+				   int bandMinF, int bandMaxF, float sigma, float level)
+{
+	// Butterworth 4th order = two sections of these Q.
+	static const double kQ[kSections] = { 0.54119610, 1.30656296 };
+
+	release();
+
+	pcm = pcmp;
+	pcmLength = length;
+	samplingRate = rate;
+	minF = bandMinF;
+	maxF = bandMaxF;
+	centerF = (minF + maxF) / 2.0F;
+	if (maxF >= samplingRate/2.0F)
+		return -1;
+
+	// low-pass cutoff = half band width.
+	double cutoff = (maxF - minF) / 2.0;
+	double w0 = 2.0*M_PI*cutoff/samplingRate;
+	double dcDelay = 0.0;
+	for (int s=0; s<kSections; s++) {
+		double alpha = sin(w0) / (2.0*kQ[s]);
+		double a0 = 1.0 + alpha;
+		b0[s] = (1.0 - cos(w0)) / 2.0 / a0;
+		b1[s] = (1.0 - cos(w0)) / a0;
+		b2[s] = b0[s];
+		a1[s] = -2.0*cos(w0) / a0;
+		a2[s] = (1.0 - alpha) / a0;
+		dcDelay += 1.0 / kQ[s];
+	}
+	// group delay near DC = sum(1/Q) / wc.
+	delay = (int)(dcDelay / (2.0*M_PI*cutoff) * samplingRate + 0.5);
+	settle = delay * 8;
+
+	rotRe = cos(2.0*M_PI*centerF/samplingRate);
+	rotIm = -sin(2.0*M_PI*centerF/samplingRate);
+
+	// gaussian window of the G-Table at the band center.
+	double dev = sigma * samplingRate / centerF;
+	halfWin = (int)(dev * 3.0);
+	if (halfWin*2 + 2 >= kHistory)
+		return -1;
+	weight = (float *)malloc((halfWin*2 + 1) * sizeof(float));
+	zRe = (float *)malloc(kHistory * sizeof(float));
+	zIm = (float *)malloc(kHistory * sizeof(float));
+	if (!weight || !zRe || !zIm) {
+		release();
+		return -1;
+	}
+	double sum = 0.0;
+	for (int k=-halfWin; k<=halfWin; k++)
+		sum += exp(-0.5*k*k/(dev*dev));
+	for (int k=-halfWin; k<=halfWin; k++)
+		weight[k + halfWin] = (float)(exp(-0.5*k*k/(dev*dev)) / sum);
+
+	// base band amplitude (A/2) --> gabor_transform level. (/ sqrt(freq))
+	gain = (float)(level * samplingRate);
+
+	reset(0);
+	return 0;
+}
+
+/*
+ Restart the filter a little before the window of startIdx.
+ */
+void FMDemod::reset(int startIdx)
+{
+	phRe = 1.0;
+	phIm = 0.0;
+	memset(stRe, 0, sizeof(stRe));
+	memset(stIm, 0, sizeof(stIm));
+	memset(zRe, 0, kHistory * sizeof(float));
+	memset(zIm, 0, kHistory * sizeof(float));
+
+	nextIdx = startIdx + delay - halfWin - settle;
+	if (nextIdx < 0)
+		nextIdx = 0;
+}
+
+void FMDemod::feed(int endIdx)
+{
+	if (endIdx > pcmLength)
+		endIdx = pcmLength;
+
+	for (; nextIdx < endIdx; nextIdx++) {
+		double x = pcm[nextIdx];
+		double zr = x * phRe;
+		double zi = x * phIm;
+		double pr = phRe;
+		phRe = pr*rotRe - phIm*rotIm;
+		phIm = pr*rotIm + phIm*rotRe;
+
+		for (int s=0; s<kSections; s++) {
+			double yr = b0[s]*zr + stRe[s][0];
+			double yi = b0[s]*zi + stIm[s][0];
+			stRe[s][0] = b1[s]*zr - a1[s]*yr + stRe[s][1];
+			stIm[s][0] = b1[s]*zi - a1[s]*yi + stIm[s][1];
+			stRe[s][1] = b2[s]*zr - a2[s]*yr;
+			stIm[s][1] = b2[s]*zi - a2[s]*yi;
+			zr = yr;
+			zi = yi;
+		}
+		zRe[nextIdx & (kHistory-1)] = (float)zr;
+		zIm[nextIdx & (kHistory-1)] = (float)zi;
+
+		// keep the phasor on the unit circle.
+		if ((nextIdx & 1023) == 0) {
+			double n = 1.0 / sqrt(phRe*phRe + phIm*phIm);
+			phRe *= n;
+			phIm *= n;
+		}
+	}
+}
+
+/*
+ Frequency around the pcm position centerIdx, -1 if the band level does
+ not reach threshold. Requests are expected in ascending order.
+ */
+int FMDemod::estimate(int centerIdx, float threshold)
+{
+	int first = centerIdx + delay - halfWin;	// window start in the filter output.
+	int last = centerIdx + delay + halfWin + 1;
+	if (first < 0 || last >= pcmLength)
+		return -1;
+	if (first < nextIdx - kHistory || first - settle > nextIdx)
+		reset(centerIdx);
+	feed(last + 1);
+
+	// sum of w * z[n+1] * conj(z[n])
+	float sr = 0.0F;
+	float si = 0.0F;
+	for (int k=0; k<=halfWin*2; k++) {
+		int n0 = (first + k) & (kHistory-1);
+		int n1 = (first + k + 1) & (kHistory-1);
+		float w = weight[k];
+		sr += w * (zRe[n1]*zRe[n0] + zIm[n1]*zIm[n0]);
+		si += w * (zIm[n1]*zRe[n0] - zRe[n1]*zIm[n0]);
+	}
+
+	float dw = atan2f(si, sr);					// rad per sample from the center.
+	float freq = centerF + dw * samplingRate / (float)(2.0*M_PI);
+
+	// level: window sum of z turned back by dw = gabor_transform at freq.
+	// (the band power would count the noise of the whole band)
+	float cr = 0.0F;
+	float ci = 0.0F;
+	float rr = cosf(dw);
+	float ri = -sinf(dw);
+	float pr = 1.0F;
+	float pi = 0.0F;
+	for (int k=0; k<=halfWin*2; k++) {
+		int n = (first + k) & (kHistory-1);
+		float w = weight[k];
+		cr += w * (zRe[n]*pr - zIm[n]*pi);
+		ci += w * (zRe[n]*pi + zIm[n]*pr);
+		float t = pr;
+		pr = t*rr - pi*ri;
+		pi = t*ri + pi*rr;
+	}
+	if (freq < minF) freq = (float)minF;
+	if (freq > maxF) freq = (float)maxF;
+	float mag = sqrtf(cr*cr + ci*ci) * gain / sqrtf(freq);
+	if (mag <= threshold)
+		return -1;
+
+	return (int)freq;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+ Instantaneous frequency demodulator.
+
+ The PCM stream is mixed down at the band center and low-passed by a 4th
+ order Butterworth filter (I/Q), which gives the analytic signal of the
+ minF .. maxF band shifted to base band. The frequency at a position is read
+ from the phase derivative: arg of the gaussian weighted sum of
+ z[n+1]*conj(z[n]) around the position, the window width is the same as the
+ G-Table gaussian at the band center. The level compared with threshold is
+ the window sum of z turned back to that frequency, i.e. the Gabor
+ magnitude. Only the new samples are fed, so one estimate costs a few filter
+ steps and two window sums.
+ */
+class FMDemod
+{
+private:
+	static const int kSections = 2;			// biquad sections.
+	static const int kHistory = 2048;		// power of 2. must exceed the window.
+
+	float	samplingRate;
+	float	centerF;
+	int		minF;
+	int		maxF;
+	float	gain;							// scale to gabor_transform level. (* 1/sqrt(f))
+
+	double	b0[kSections], b1[kSections], b2[kSections];
+	double	a1[kSections], a2[kSections];
+	double	stRe[kSections][2], stIm[kSections][2];	// transposed direct form II.
+	double	rotRe, rotIm;					// phasor step.
+	double	phRe, phIm;						// current phasor.
+	int		delay;							// group delay of the low-pass (samples)
+	int		settle;							// samples fed before a window after reset.
+
+	float	*weight;						// [halfWin*2+1] gaussian window.
+	int		halfWin;
+	float	*zRe, *zIm;						// [kHistory] base band signal.
+
+	const float *pcm;
+	int		pcmLength;
+	int		nextIdx;						// next pcm index to feed.
+
+	void release(void);
+	void feed(int endIdx);
+
+public:
+	FMDemod(void);
+	virtual ~FMDemod(void);
+
+	int setup(const float *pcmp, int length, float samplingRate,
+			  int minF, int maxF, float sigma, float level);
+	void reset(int startIdx);
+	int estimate(int centerIdx, float threshold);
+};
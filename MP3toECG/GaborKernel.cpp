@@ -0,0 +1,364 @@
+#include "stdafx.h"
+#include "GaborKernel.h"
+
+#include <intrin.h>
+#include <immintrin.h>
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <malloc.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// AVX-512 intrinsics need VS2017 or later.
+#if !defined(GABOR_USE_AVX512) && defined(_MSC_VER) && _MSC_VER >= 1910
+#define GABOR_USE_AVX512
+#endif
+
+//****************************** Dot Product Kernels ***********************//
+
+static void dotScalar(const float *pcm, const float *re, const float *im, int len,
+					  float *real_wt, float *imag_wt)
+{
+	float real_sum = 0;
+	float imag_sum = 0;
+
+	for (int m = 0; m < len; m++) {
+		real_sum += pcm[m] * re[m];
+		imag_sum += pcm[m] * im[m];
+	}
+	*real_wt = real_sum;
+	*imag_wt = imag_sum;
+}
+
+static float hsum128(__m128 v)
+{
+	__m128 sh = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 s  = _mm_add_ps(v, sh);
+	sh = _mm_movehl_ps(sh, s);
+	s  = _mm_add_ss(s, sh);
+	return _mm_cvtss_f32(s);
+}
+
+static void dotSSE2(const float *pcm, const float *re, const float *im, int len,
+					float *real_wt, float *imag_wt)
+{
+	__m128 r0 = _mm_setzero_ps(), r1 = _mm_setzero_ps();
+	__m128 i0 = _mm_setzero_ps(), i1 = _mm_setzero_ps();
+
+	for (int m = 0; m < len; m += 8) {
+		__m128 p0 = _mm_loadu_ps(&pcm[m]);
+		__m128 p1 = _mm_loadu_ps(&pcm[m+4]);
+		r0 = _mm_add_ps(r0, _mm_mul_ps(p0, _mm_load_ps(&re[m])));
+		i0 = _mm_add_ps(i0, _mm_mul_ps(p0, _mm_load_ps(&im[m])));
+		r1 = _mm_add_ps(r1, _mm_mul_ps(p1, _mm_load_ps(&re[m+4])));
+		i1 = _mm_add_ps(i1, _mm_mul_ps(p1, _mm_load_ps(&im[m+4])));
+	}
+	*real_wt = hsum128(_mm_add_ps(r0, r1));
+	*imag_wt = hsum128(_mm_add_ps(i0, i1));
+}
+
+static void dotAVX2(const float *pcm, const float *re, const float *im, int len,
+					float *real_wt, float *imag_wt)
+{
+	__m256 r0 = _mm256_setzero_ps(), r1 = _mm256_setzero_ps();
+	__m256 i0 = _mm256_setzero_ps(), i1 = _mm256_setzero_ps();
+
+	for (int m = 0; m < len; m += 16) {
+		__m256 p0 = _mm256_loadu_ps(&pcm[m]);
+		__m256 p1 = _mm256_loadu_ps(&pcm[m+8]);
+		r0 = _mm256_fmadd_ps(p0, _mm256_load_ps(&re[m]),   r0);
+		i0 = _mm256_fmadd_ps(p0, _mm256_load_ps(&im[m]),   i0);
+		r1 = _mm256_fmadd_ps(p1, _mm256_load_ps(&re[m+8]), r1);
+		i1 = _mm256_fmadd_ps(p1, _mm256_load_ps(&im[m+8]), i1);
+	}
+	__m256 r = _mm256_add_ps(r0, r1);
+	__m256 i = _mm256_add_ps(i0, i1);
+	*real_wt = hsum128(_mm_add_ps(_mm256_castps256_ps128(r), _mm256_extractf128_ps(r, 1)));
+	*imag_wt = hsum128(_mm_add_ps(_mm256_castps256_ps128(i), _mm256_extractf128_ps(i, 1)));
+	_mm256_zeroupper();
+}
+
+#ifdef GABOR_USE_AVX512
+static void dotAVX512(const float *pcm, const float *re, const float *im, int len,
+					  float *real_wt, float *imag_wt)
+{
+	__m512 r0 = _mm512_setzero_ps();
+	__m512 i0 = _mm512_setzero_ps();
+
+	for (int m = 0; m < len; m += 16) {
+		__m512 p0 = _mm512_loadu_ps(&pcm[m]);
+		r0 = _mm512_fmadd_ps(p0, _mm512_load_ps(&re[m]), r0);
+		i0 = _mm512_fmadd_ps(p0, _mm512_load_ps(&im[m]), i0);
+	}
+	*real_wt = _mm512_reduce_add_ps(r0);
+	*imag_wt = _mm512_reduce_add_ps(i0);
+	_mm256_zeroupper();
+}
+#endif
+
+//****************************** Gabor Kernel ***********************//
+
+GaborKernel::GaborKernel(void)
+{
+	rows = 0;
+	total = 0;
+	owner = true;
+	dxlen = padlen = offset = nullptr;
+	re = im = nullptr;
+	level = KernelScalar;
+	dot = dotScalar;
+}
+
+GaborKernel::~GaborKernel(void)
+{
+	release();
+}
+
+void GaborKernel::release(void)
+{
+	if (owner) {
+		if (dxlen)	free(dxlen);
+		if (padlen)	free(padlen);
+		if (offset)	free(offset);
+		if (re)		_aligned_free(re);
+		if (im)		_aligned_free(im);
+	}
+	dxlen = padlen = offset = nullptr;
+	re = im = nullptr;
+	rows = 0;
+	total = 0;
+	owner = true;
+}
+
+/*
+ Lay out the rows from dxlen[] and allocate the cleared re/im arrays.
+ */
+int GaborKernel::allocate(int count)
+{
+	total = 0;
+	for (int r=0; r<count; r++) {
+		int len = dxlen[r]*2 + 1;
+		padlen[r] = (len + kPadFactors-1) / kPadFactors * kPadFactors;
+		offset[r] = total;
+		total += padlen[r];
+	}
+
+	re = (float *)_aligned_malloc((size_t)total * sizeof(float), kAlignment);
+	im = (float *)_aligned_malloc((size_t)total * sizeof(float), kAlignment);
+	if (!re || !im)
+		return -1;
+	memset(re, 0, (size_t)total * sizeof(float));
+	memset(im, 0, (size_t)total * sizeof(float));
+	return 0;
+}
+
+/*
+ Convert the interleaved G-Table to the padded structure-of-arrays layout.
+ */
+int GaborKernel::build(const __int32 *srcDxlen, const __int32 *srcOffset, const float *srcTbl, int count)
+{
+	release();
+
+	rows = count;
+	dxlen  = (int *)malloc(rows * sizeof(int));
+	padlen = (int *)malloc(rows * sizeof(int));
+	offset = (int *)malloc(rows * sizeof(int));
+	if (!dxlen || !padlen || !offset) {
+		release();
+		return -1;
+	}
+	for (int r=0; r<rows; r++)
+		dxlen[r] = srcDxlen[r];
+	if (allocate(rows)) {
+		release();
+		return -1;
+	}
+
+	for (int r=0; r<rows; r++) {
+		const float *gf = &srcTbl[srcOffset[r]];
+		int len = dxlen[r]*2 + 1;
+		for (int m=0; m<len; m++) {
+			re[offset[r] + m] = *gf++;
+			im[offset[r] + m] = *gf++;
+		}
+	}
+
+	select(detectLevel());
+	return 0;
+}
+
+/*
+ Factors of the rows first, first+step, ... (same formula as maketabl)
+ */
+void GaborKernel::fillRows(const fillParams *params, int first, int step)
+{
+	int samplingRate = params->samplingRate;
+	float sigma = params->sigma;
+	int minF = params->minF;
+	float level = params->level;
+
+	for (int r=first; r<rows; r+=step) {
+		float a = 1.0F/(float)(minF + r);				// 1 / frequency
+		float *rp = &re[offset[r]];
+		float *ip = &im[offset[r]];
+		int dx = dxlen[r];
+
+		for (int m = -dx; m <= dx; m++) {
+			float t = (float)m/samplingRate/a;
+			float gauss = 1.0F/sqrtf(2.0F*(float)M_PI*sigma*sigma) * expf(-t*t/(2.0F*sigma*sigma));
+			float omega_t = 2.0F*(float)M_PI*t;
+			*rp++ = level * gauss * cosf(omega_t);
+			*ip++ = level * gauss * sinf(omega_t);
+		}
+	}
+}
+
+/*
+ Compute the G-Table for any sampling rate. row r = frequency minF + r.
+ level scales the factors (magnitude relative to the G-Table files).
+ */
+int GaborKernel::generate(int samplingRate, float sigma, int minF, int count, float level, int threads)
+{
+	release();
+
+	rows = count;
+	dxlen  = (int *)malloc(rows * sizeof(int));
+	padlen = (int *)malloc(rows * sizeof(int));
+	offset = (int *)malloc(rows * sizeof(int));
+	if (!dxlen || !padlen || !offset) {
+		release();
+		return -1;
+	}
+	for (int r=0; r<rows; r++) {
+		float a = 1.0F/(float)(minF + r);
+		float dt = a*sigma*sqrtf(-2.0F*logf(0.01F));	// window width (sec)
+		dxlen[r] = (int)(dt * samplingRate);
+	}
+	if (allocate(rows)) {
+		release();
+		return -1;
+	}
+
+	// rows are interleaved over the threads. (row length decreases with frequency)
+	if (threads < 1)
+		threads = 1;
+	fillParams params;
+	params.samplingRate = samplingRate;
+	params.sigma = sigma;
+	params.minF = minF;
+	params.level = level;
+	std::vector<std::thread> workers;
+	for (int t=1; t<threads; t++)
+		workers.push_back(std::thread(&GaborKernel::fillRows, this, &params, t, threads));
+	fillRows(&params, 0, threads);
+	for (size_t t=0; t<workers.size(); t++)
+		workers[t].join();
+
+	select(detectLevel());
+	return 0;
+}
+
+/*
+ Use a table image that is already in the padded layout. (mapped file)
+ The arrays are not copied and must stay valid while the kernel is used.
+ */
+int GaborKernel::attach(const __int32 *imgDxlen, const __int32 *imgPadlen, const __int32 *imgOffset,
+						const float *imgRe, const float *imgIm, int count, int factors)
+{
+	release();
+
+	for (int r=0; r<count; r++) {
+		if (imgPadlen[r] % kPadFactors || imgPadlen[r] < imgDxlen[r]*2 + 1 ||
+			imgOffset[r] < 0 || imgOffset[r] + imgPadlen[r] > factors)
+			return -1;
+	}
+	if (((size_t)imgRe | (size_t)imgIm) & (kAlignment-1))
+		return -1;
+
+	owner = false;
+	rows = count;
+	total = factors;
+	dxlen  = const_cast<int *>((const int *)imgDxlen);
+	padlen = const_cast<int *>((const int *)imgPadlen);
+	offset = const_cast<int *>((const int *)imgOffset);
+	re = const_cast<float *>(imgRe);
+	im = const_cast<float *>(imgIm);
+
+	select(detectLevel());
+	return 0;
+}
+
+/*
+ Samples around the center read by transform(). (both sides)
+ */
+int GaborKernel::getReach(void)
+{
+	int reach = 0;
+	for (int r=0; r<rows; r++) {
+		if (dxlen[r] > reach)
+			reach = dxlen[r];
+		if (padlen[r] - dxlen[r] > reach)
+			reach = padlen[r] - dxlen[r];
+	}
+	return reach;
+}
+
+int GaborKernel::detectLevel(void)
+{
+	int info[4];
+	int detect = KernelScalar;
+
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	if (info[3] & (1 << 26))						// SSE2
+		detect = KernelSSE2;
+
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx     = (info[2] & (1 << 28)) != 0;
+	bool fma     = (info[2] & (1 << 12)) != 0;
+	if (osxsave && avx && fma && maxLeaf >= 7) {
+		unsigned __int64 xcr0 = _xgetbv(0);
+		if ((xcr0 & 0x06) == 0x06) {				// XMM, YMM state enabled by OS.
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5))					// AVX2
+				detect = KernelAVX2;
+			if ((info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6)	// AVX-512F, ZMM state
+				detect = KernelAVX512;
+		}
+	}
+	return detect;
+}
+
+/*
+ Select the kernel. the level is limited by the CPU and by this build.
+ */
+void GaborKernel::select(int maxLevel)
+{
+	int cpuLevel = detectLevel();
+	level = (maxLevel < cpuLevel) ? maxLevel : cpuLevel;
+
+#ifndef GABOR_USE_AVX512
+	if (level == KernelAVX512)
+		level = KernelAVX2;
+#endif
+	switch (level) {
+	case KernelSSE2:	dot = dotSSE2;		break;
+	case KernelAVX2:	dot = dotAVX2;		break;
+#ifdef GABOR_USE_AVX512
+	case KernelAVX512:	dot = dotAVX512;	break;
+#endif
+	default:			dot = dotScalar;	level = KernelScalar;	break;
+	}
+}
+
+const char *GaborKernel::getLevelName(void)
+{
+	switch (level) {
+	case KernelSSE2:	return "SSE2";
+	case KernelAVX2:	return "AVX2";
+	case KernelAVX512:	return "AVX-512";
+	default:			return "Scalar";
+	}
+}
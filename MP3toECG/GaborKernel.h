@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+ Vectorized Gabor dot product.
+
+ The G-Table file stores the factors as interleaved (cos, sin) pairs. At load
+ time they are split into two aligned arrays (real / imaginary), every row is
+ padded with zeros to a multiple of kPadFactors, and the fastest kernel
+ supported by the CPU (SSE2 / AVX2+FMA / AVX-512) is selected.
+ For sampling rates without a G-Table file, generate() computes the
+ factors directly in this layout.
+ */
+class GaborKernel
+{
+public:
+	enum {
+		KernelScalar,
+		KernelSSE2,
+		KernelAVX2,
+		KernelAVX512,
+	};
+	static const int kPadFactors = 16;		// factors per row = n * 16
+	static const int kAlignment = 64;		// byte
+
+private:
+	int		rows;
+	int		total;							// factors per re/im array.
+	bool	owner;							// false: arrays are in a mapped image.
+	int		*dxlen;							// [rows] half width (samples)
+	int		*padlen;						// [rows] padded row length
+	int		*offset;						// [rows] row start in re/im
+	float	*re;							// gauss * cos
+	float	*im;							// gauss * sin
+	int		level;
+
+	typedef void (*dotFunc)(const float *pcm, const float *re, const float *im, int len,
+							float *real_wt, float *imag_wt);
+	dotFunc	dot;
+
+	struct fillParams {						// generate() for the threads. (VS2012 std::thread: 5 arguments)
+		int		samplingRate;
+		float	sigma;
+		int		minF;
+		float	level;
+	};
+
+	void release(void);
+	int allocate(int count);
+	void fillRows(const fillParams *params, int first, int step);
+
+public:
+	GaborKernel(void);
+	virtual ~GaborKernel(void);
+
+	int build(const __int32 *srcDxlen, const __int32 *srcOffset, const float *srcTbl, int count);
+	int generate(int samplingRate, float sigma, int minF, int count, float level, int threads);
+	int attach(const __int32 *imgDxlen, const __int32 *imgPadlen, const __int32 *imgOffset,
+			   const float *imgRe, const float *imgIm, int count, int factors);
+	void select(int maxLevel);
+	int getLevel(void) { return level; }
+	const char *getLevelName(void);
+	int getRows(void) { return rows; }
+	int getTotal(void) { return total; }
+	int getDxlen(int row) { return dxlen[row]; }
+	int getReach(void);
+	int getPadlen(int row) { return padlen[row]; }
+	int getOffset(int row) { return offset[row]; }
+	const float *getRe(int row) { return &re[offset[row]]; }
+	const float *getIm(int row) { return &im[offset[row]]; }
+
+	// pcm: center position of the window, row: freq - tbl_minf
+	void transform(const float *pcm, int row, float *real_wt, float *imag_wt) {
+		int dx = dxlen[row];
+		dot(&pcm[-dx], &re[offset[row]], &im[offset[row]], padlen[row], real_wt, imag_wt);
+	}
+
+	static int detectLevel(void);
+};
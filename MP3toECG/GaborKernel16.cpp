@@ -0,0 +1,202 @@
+#include "stdafx.h"
+#include "GaborKernel16.h"
+
+#include <immintrin.h>
+#include <limits.h>
+#include <math.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+//****************************** Dot Product Kernels ***********************//
+
+static void dot16Scalar(const __int16 *pcm, const __int16 *re, const __int16 *im, int len,
+						int *real_sum, int *imag_sum)
+{
+	int real_acc = 0;
+	int imag_acc = 0;
+
+	for (int m = 0; m < len; m++) {
+		real_acc += pcm[m] * re[m];
+		imag_acc += pcm[m] * im[m];
+	}
+	*real_sum = real_acc;
+	*imag_sum = imag_acc;
+}
+
+static int hsum128i(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v);
+}
+
+static void dot16SSE2(const __int16 *pcm, const __int16 *re, const __int16 *im, int len,
+					  int *real_sum, int *imag_sum)
+{
+	__m128i r0 = _mm_setzero_si128(), r1 = _mm_setzero_si128();
+	__m128i i0 = _mm_setzero_si128(), i1 = _mm_setzero_si128();
+
+	for (int m = 0; m < len; m += 16) {
+		__m128i p0 = _mm_loadu_si128((const __m128i *)&pcm[m]);
+		__m128i p1 = _mm_loadu_si128((const __m128i *)&pcm[m+8]);
+		r0 = _mm_add_epi32(r0, _mm_madd_epi16(p0, _mm_load_si128((const __m128i *)&re[m])));
+		i0 = _mm_add_epi32(i0, _mm_madd_epi16(p0, _mm_load_si128((const __m128i *)&im[m])));
+		r1 = _mm_add_epi32(r1, _mm_madd_epi16(p1, _mm_load_si128((const __m128i *)&re[m+8])));
+		i1 = _mm_add_epi32(i1, _mm_madd_epi16(p1, _mm_load_si128((const __m128i *)&im[m+8])));
+	}
+	*real_sum = hsum128i(_mm_add_epi32(r0, r1));
+	*imag_sum = hsum128i(_mm_add_epi32(i0, i1));
+}
+
+static void dot16AVX2(const __int16 *pcm, const __int16 *re, const __int16 *im, int len,
+					  int *real_sum, int *imag_sum)
+{
+	__m256i r0 = _mm256_setzero_si256();
+	__m256i i0 = _mm256_setzero_si256();
+
+	for (int m = 0; m < len; m += 16) {
+		__m256i p0 = _mm256_loadu_si256((const __m256i *)&pcm[m]);
+		r0 = _mm256_add_epi32(r0, _mm256_madd_epi16(p0, _mm256_load_si256((const __m256i *)&re[m])));
+		i0 = _mm256_add_epi32(i0, _mm256_madd_epi16(p0, _mm256_load_si256((const __m256i *)&im[m])));
+	}
+	*real_sum = hsum128i(_mm_add_epi32(_mm256_castsi256_si128(r0), _mm256_extracti128_si256(r0, 1)));
+	*imag_sum = hsum128i(_mm_add_epi32(_mm256_castsi256_si128(i0), _mm256_extracti128_si256(i0, 1)));
+	_mm256_zeroupper();
+}
+
+//****************************** Gabor Kernel (16 bit) ***********************//
+
+GaborKernel16::GaborKernel16(void)
+{
+	rows = 0;
+	dxlen = padlen = offset = nullptr;
+	re = im = nullptr;
+	unit = bound = nullptr;
+	level = GaborKernel::KernelScalar;
+	dot = dot16Scalar;
+}
+
+GaborKernel16::~GaborKernel16(void)
+{
+	release();
+}
+
+void GaborKernel16::release(void)
+{
+	if (dxlen)	free(dxlen);
+	if (padlen)	free(padlen);
+	if (offset)	free(offset);
+	if (re)		_aligned_free(re);
+	if (im)		_aligned_free(im);
+	if (unit)	free(unit);
+	if (bound)	free(bound);
+	dxlen = padlen = offset = nullptr;
+	re = im = nullptr;
+	unit = bound = nullptr;
+	rows = 0;
+}
+
+/*
+ Quantize the rows of the float kernel.
+ */
+int GaborKernel16::build(GaborKernel &src)
+{
+	release();
+
+	int count = src.getRows();
+	int total = src.getTotal();
+	dxlen  = (int *)malloc(count * sizeof(int));
+	padlen = (int *)malloc(count * sizeof(int));
+	offset = (int *)malloc(count * sizeof(int));
+	unit   = (float *)malloc(count * sizeof(float));
+	bound  = (float *)malloc(count * sizeof(float));
+	re = (__int16 *)_aligned_malloc((size_t)total * sizeof(__int16), GaborKernel::kAlignment);
+	im = (__int16 *)_aligned_malloc((size_t)total * sizeof(__int16), GaborKernel::kAlignment);
+	if (!dxlen || !padlen || !offset || !unit || !bound || !re || !im) {
+		release();
+		return -1;
+	}
+	memset(re, 0, (size_t)total * sizeof(__int16));
+	memset(im, 0, (size_t)total * sizeof(__int16));
+
+	for (int r=0; r<count; r++) {
+		dxlen[r] = src.getDxlen(r);
+		padlen[r] = src.getPadlen(r);
+		offset[r] = src.getOffset(r);
+
+		const float *sre = src.getRe(r);
+		const float *sim = src.getIm(r);
+		double sumRe = 0.0, sumIm = 0.0, peak = 0.0;
+		for (int m=0; m<padlen[r]; m++) {
+			sumRe += fabs(sre[m]);
+			sumIm += fabs(sim[m]);
+			if (fabs(sre[m]) > peak) peak = fabs(sre[m]);
+			if (fabs(sim[m]) > peak) peak = fabs(sim[m]);
+		}
+		double sum = (sumRe > sumIm) ? sumRe : sumIm;
+		if (sum <= 0.0) {
+			unit[r] = bound[r] = 0.0F;
+			continue;
+		}
+		// the rounding adds up to 0.5 per factor.
+		double scale = (kSumLimit - 0.5*padlen[r]) / sum;
+		if (scale * peak > SHRT_MAX)
+			scale = SHRT_MAX / peak;
+
+		__int16 *qre = &re[offset[r]];
+		__int16 *qim = &im[offset[r]];
+		for (int m=0; m<padlen[r]; m++) {
+			qre[m] = (__int16)floor(sre[m]*scale + 0.5);
+			qim[m] = (__int16)floor(sim[m]*scale + 0.5);
+		}
+		unit[r] = (float)(1.0 / (scale * SHRT_MAX));
+		bound[r] = (float)(0.5 * (2*dxlen[r] + 1) / scale);
+	}
+	rows = count;
+
+	select(GaborKernel::detectLevel());
+	return 0;
+}
+
+/*
+ Error bound of gabor_transform at baseF + row for full scale PCM.
+ */
+float GaborKernel16::getBound(int row, int baseF)
+{
+	return sqrtf((float)(baseF + row)) * sqrtf(2.0F) * bound[row];
+}
+
+int GaborKernel16::getBytes(void)
+{
+	int bytes = 0;
+	for (int r=0; r<rows; r++)
+		bytes += padlen[r] * 2 * sizeof(__int16);
+	return bytes;
+}
+
+/*
+ Select the kernel. (no AVX-512 variant: AVX2 is used)
+ */
+void GaborKernel16::select(int maxLevel)
+{
+	int cpuLevel = GaborKernel::detectLevel();
+	level = (maxLevel < cpuLevel) ? maxLevel : cpuLevel;
+	if (level > GaborKernel::KernelAVX2)
+		level = GaborKernel::KernelAVX2;
+
+	switch (level) {
+	case GaborKernel::KernelSSE2:	dot = dot16SSE2;	break;
+	case GaborKernel::KernelAVX2:	dot = dot16AVX2;	break;
+	default:	dot = dot16Scalar;	level = GaborKernel::KernelScalar;	break;
+	}
+}
+
+const char *GaborKernel16::getLevelName(void)
+{
+	switch (level) {
+	case GaborKernel::KernelSSE2:	return "int16 SSE2";
+	case GaborKernel::KernelAVX2:	return "int16 AVX2";
+	default:						return "int16 Scalar";
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "GaborKernel.h"
+
+/*
+ Fixed point Gabor dot product. (-e int16)
+
+ The factors of a GaborKernel are quantized to 16 bit per row and the PCM is
+ read as 16 bit, the products are summed in 32 bit (pmaddwd). It moves half
+ the bytes of the float kernel per factor.
+
+ Row r is scaled by scale[r], chosen so that the sum of |factor| stays below
+ 65536: then no 16 bit PCM can overflow the 32 bit sum. The rounding of a
+ factor is at most 0.5, so against the float kernel on the same 16 bit PCM
+
+   |real_wt - float real_wt| <= 0.5 / scale[r] * sum(|pcm[m]|) / 32767
+
+ (imag_wt the same). getBound() gives it for full scale PCM in the units of
+ gabor_transform (* sqrt(freq), both parts).
+ */
+class GaborKernel16
+{
+private:
+	static const int kSumLimit = 65535;		// sum of |factor| per row. (32768 * 65535 < 2^31)
+
+	int		rows;
+	int		*dxlen;							// [rows] same layout as the float kernel.
+	int		*padlen;
+	int		*offset;
+	__int16	*re;
+	__int16	*im;
+	float	*unit;							// [rows] 1 / (scale * 32767)
+	float	*bound;							// [rows] error bound of a part. (full scale)
+	int		level;
+
+	typedef void (*dotFunc)(const __int16 *pcm, const __int16 *re, const __int16 *im, int len,
+							int *real_sum, int *imag_sum);
+	dotFunc	dot;
+
+	void release(void);
+
+public:
+	GaborKernel16(void);
+	virtual ~GaborKernel16(void);
+
+	int build(GaborKernel &src);
+	bool isReady(void) { return rows > 0; }
+	void select(int maxLevel);
+	int getLevel(void) { return level; }
+	const char *getLevelName(void);
+	int getBytes(void);
+	float getBound(int row, int baseF);
+
+	// pcm: center position of the window, row: freq - tbl_minf
+	void transform(const __int16 *pcm, int row, float *real_wt, float *imag_wt) {
+		int real_sum, imag_sum;
+		dot(&pcm[-dxlen[row]], &re[offset[row]], &im[offset[row]], padlen[row], &real_sum, &imag_sum);
+		*real_wt = (float)real_sum * unit[row];
+		*imag_wt = (float)imag_sum * unit[row];
+	}
+};
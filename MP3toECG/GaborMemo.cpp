@@ -0,0 +1,35 @@
+#include "stdafx.h"
+#include "GaborMemo.h"
+
+#include <stdlib.h>
+
+GaborMemo::GaborMemo(void)
+{
+	table = nullptr;
+	hits = 0;
+	misses = 0;
+}
+
+GaborMemo::~GaborMemo(void)
+{
+	if (table)	free(table);
+}
+
+int GaborMemo::setup(void)
+{
+	if (!table) {
+		table = (entry *)malloc(sizeof(entry) * kSize);
+		if (!table)
+			return -1;
+	}
+	clear();
+	return 0;
+}
+
+void GaborMemo::clear(void)
+{
+	for (int i=0; i<kSize; i++)
+		table[i].index = -1;
+	hits = 0;
+	misses = 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+ Memo of Gabor magnitudes. (sample index, frequency) --> gabor_transform row.
+
+ The header detection steps back to the sweep start on a failure, the PLL
+ of the calibration and the serial number moves currentPCMTime back and
+ forth, and fast_fcnv evaluates the same rows again in its finer passes,
+ so the same magnitudes are computed many times. The memo is a direct
+ mapped table: an entry is overwritten by the next key of the same slot,
+ so the memory is fixed and a lookup is one compare. It is filled and read
+ by one thread only (not by the estimateParallel workers).
+ */
+class GaborMemo
+{
+private:
+	static const int kBits = 16;			// 64K entries. (768 KByte)
+	static const int kSize = 1 << kBits;
+
+	struct entry {
+		int		index;						// -1: empty.
+		int		freq;
+		float	value;
+	};
+	entry	*table;
+	long long hits;
+	long long misses;
+
+	static unsigned int slot(int index, int freq) {
+		unsigned int h = (unsigned int)index * 0x9e3779b1U ^ (unsigned int)freq * 0x85ebca77U;
+		return (h ^ (h >> 15)) & (kSize - 1);
+	}
+
+public:
+	GaborMemo(void);
+	virtual ~GaborMemo(void);
+
+	int setup(void);
+	void clear(void);
+	long long getHits(void) { return hits; }
+	long long getMisses(void) { return misses; }
+
+	bool find(int index, int freq, float *value) {
+		const entry &e = table[slot(index, freq)];
+		if (e.index == index && e.freq == freq) {
+			*value = e.value;
+			hits++;
+			return true;
+		}
+		misses++;
+		return false;
+	}
+	void put(int index, int freq, float value) {
+		entry &e = table[slot(index, freq)];
+		e.index = index;
+		e.freq = freq;
+		e.value = value;
+	}
+};
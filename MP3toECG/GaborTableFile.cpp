@@ -0,0 +1,185 @@
+#include "stdafx.h"
+#include "GaborTableFile.h"
+#include "ErrorStatusNo.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stddef.h>
+#include <string.h>
+
+static const char kMagic[4] = {'G', 'F', 'T', 'B'};
+
+static int alignPos(int pos)
+{
+	return (pos + GaborTableFile::kImageAlign-1) / GaborTableFile::kImageAlign * GaborTableFile::kImageAlign;
+}
+
+GaborTableFile::GaborTableFile(void)
+{
+	hFile = INVALID_HANDLE_VALUE;
+	hMap = NULL;
+	view = nullptr;
+	viewSize = 0;
+}
+
+GaborTableFile::~GaborTableFile(void)
+{
+	close();
+}
+
+void GaborTableFile::close(void)
+{
+	if (view)	UnmapViewOfFile(view);
+	if (hMap)	CloseHandle(hMap);
+	if (hFile != INVALID_HANDLE_VALUE)	CloseHandle(hFile);
+	hFile = INVALID_HANDLE_VALUE;
+	hMap = NULL;
+	view = nullptr;
+	viewSize = 0;
+}
+
+/*
+ 64-bit FNV-1a over 8 byte words. (bytes: multiple of 8)
+ */
+unsigned __int64 GaborTableFile::checksum(const void *data, size_t bytes)
+{
+	const unsigned __int64 *p = (const unsigned __int64 *)data;
+	unsigned __int64 h = 0xcbf29ce484222325ULL;
+
+	for (size_t i=0; i<bytes/8; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/*
+ Map the image read-only and check the header (and the payload when
+ verifyPayload). -1: no file or not valid.
+ */
+int GaborTableFile::open(const char *path, int samplingRate, float sigma, int minF, int maxF, bool verifyPayload)
+{
+	close();
+
+	hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return -1;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size) || size.QuadPart < kHeaderBlock) {
+		close();
+		return -1;
+	}
+	hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMap)
+		view = (const unsigned char *)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		close();
+		return -1;
+	}
+	viewSize = (size_t)size.QuadPart;
+
+	const gaborTableHeader *hdr = (const gaborTableHeader *)view;
+	const char *reason = nullptr;
+	if (memcmp(hdr->magic, kMagic, sizeof(kMagic)) != 0)
+		reason = "magic";
+	else if (hdr->version != kVersion || hdr->headerSize != sizeof(gaborTableHeader))
+		reason = "version";
+	else if (hdr->headerSum != checksum(hdr, offsetof(gaborTableHeader, headerSum)))
+		reason = "header checksum";
+	else if (hdr->samplingRate != samplingRate || hdr->sigma != sigma ||
+			 hdr->minF != minF || hdr->maxF != maxF || hdr->rows != maxF - minF)
+		reason = "parameter";
+	else if ((size_t)hdr->fileSize != viewSize ||
+			 hdr->dxlenPos < kHeaderBlock || hdr->dxlenPos + hdr->rows*4 > hdr->padlenPos ||
+			 hdr->padlenPos + hdr->rows*4 > hdr->offsetPos || hdr->offsetPos + hdr->rows*4 > hdr->rePos ||
+			 hdr->rePos % kImageAlign || hdr->imPos % kImageAlign ||
+			 hdr->rePos + hdr->factors*4 > hdr->imPos || hdr->imPos + hdr->factors*4 > hdr->fileSize)
+		reason = "size";
+	else if (verifyPayload && hdr->payloadSum != checksum(view + kHeaderBlock, viewSize - kHeaderBlock))
+		reason = "payload checksum";
+
+	if (reason) {
+		std::cerr << "Warning! G-Table image is not valid (" << reason << "):" << path << "\n";
+		close();
+		return -1;
+	}
+	return ERR_OK;
+}
+
+int GaborTableFile::attach(GaborKernel &kernel)
+{
+	if (!view)
+		return -1;
+
+	const gaborTableHeader *hdr = (const gaborTableHeader *)view;
+	return kernel.attach((const __int32 *)(view + hdr->dxlenPos),
+						 (const __int32 *)(view + hdr->padlenPos),
+						 (const __int32 *)(view + hdr->offsetPos),
+						 (const float *)(view + hdr->rePos),
+						 (const float *)(view + hdr->imPos),
+						 hdr->rows, hdr->factors);
+}
+
+/*
+ Save the kernel layout as an image. written to a temporary file first and
+ renamed, so other processes never map a partial file.
+ */
+int GaborTableFile::write(const char *path, GaborKernel &kernel, int samplingRate, float sigma, int minF, int maxF)
+{
+	int rows = kernel.getRows();
+	int factors = kernel.getTotal();
+
+	gaborTableHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, kMagic, sizeof(kMagic));
+	hdr.version = kVersion;
+	hdr.headerSize = sizeof(gaborTableHeader);
+	hdr.samplingRate = samplingRate;
+	hdr.sigma = sigma;
+	hdr.minF = minF;
+	hdr.maxF = maxF;
+	hdr.rows = rows;
+	hdr.factors = factors;
+	hdr.dxlenPos = kHeaderBlock;
+	hdr.padlenPos = hdr.dxlenPos + rows*4;
+	hdr.offsetPos = hdr.padlenPos + rows*4;
+	hdr.rePos = alignPos(hdr.offsetPos + rows*4);
+	hdr.imPos = hdr.rePos + alignPos(factors*4);
+	hdr.fileSize = hdr.imPos + alignPos(factors*4);
+
+	unsigned char *image = (unsigned char *)calloc(hdr.fileSize, 1);
+	if (!image)
+		return -1;
+	__int32 *dx  = (__int32 *)(image + hdr.dxlenPos);
+	__int32 *pad = (__int32 *)(image + hdr.padlenPos);
+	__int32 *off = (__int32 *)(image + hdr.offsetPos);
+	for (int r=0; r<rows; r++) {
+		dx[r]  = kernel.getDxlen(r);
+		pad[r] = kernel.getPadlen(r);
+		off[r] = kernel.getOffset(r);
+	}
+	memcpy(image + hdr.rePos, kernel.getRe(0), factors*4);
+	memcpy(image + hdr.imPos, kernel.getIm(0), factors*4);
+
+	hdr.payloadSum = checksum(image + kHeaderBlock, hdr.fileSize - kHeaderBlock);
+	hdr.headerSum = checksum(&hdr, offsetof(gaborTableHeader, headerSum));
+	memcpy(image, &hdr, sizeof(hdr));
+
+	std::ostringstream tmp;
+	tmp << path << "." << GetCurrentProcessId() << ".tmp";
+	std::ofstream fs;
+	fs.open(tmp.str().c_str(), std::ios::out | std::ios::binary);
+	if (!fs.fail())
+		fs.write((const char *)image, hdr.fileSize);
+	bool failed = fs.fail();
+	fs.close();
+	free(image);
+
+	if (failed || !MoveFileExA(tmp.str().c_str(), path, MOVEFILE_REPLACE_EXISTING)) {
+		remove(tmp.str().c_str());
+		return -1;
+	}
+	return ERR_OK;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <Windows.h>
+#include "GaborKernel.h"
+
+/*
+ Versioned G-Table image. (GFactorTable441.gtb / GFactorTable480.gtb)
+
+ The file holds the padded structure-of-arrays layout of GaborKernel, so it
+ is used directly from a read-only file mapping: concurrent converter
+ processes share the same pages through the system file cache instead of
+ reading a private copy. The header (checksum, version, sizes) is validated
+ at open time; the payload checksum is computed when the image is written
+ and checked at open only on request (-X), so a run does not read every
+ page of the table.
+
+  [header (kHeaderBlock)] [dxlen] [padlen] [offset] [re] [im]
+  every section starts on a kImageAlign boundary.
+ */
+struct gaborTableHeader {
+	char	magic[4];						// 'GFTB'
+	__int32	version;
+	__int32	headerSize;						// sizeof(gaborTableHeader)
+	__int32	samplingRate;
+	float	sigma;
+	__int32	minF;
+	__int32	maxF;
+	__int32	rows;
+	__int32	factors;						// factors per re/im array.
+	__int32	dxlenPos;						// byte position in the file.
+	__int32	padlenPos;
+	__int32	offsetPos;
+	__int32	rePos;
+	__int32	imPos;
+	__int32	fileSize;
+	__int32	reserved;
+	unsigned __int64 payloadSum;			// checksum of [kHeaderBlock, fileSize)
+	unsigned __int64 headerSum;				// checksum of the fields above.
+};
+
+class GaborTableFile
+{
+public:
+	static const int kVersion = 1;
+	static const int kHeaderBlock = 128;
+	static const int kImageAlign = 64;
+
+private:
+	HANDLE	hFile;
+	HANDLE	hMap;
+	const unsigned char *view;
+	size_t	viewSize;
+
+public:
+	GaborTableFile(void);
+	virtual ~GaborTableFile(void);
+
+	int open(const char *path, int samplingRate, float sigma, int minF, int maxF, bool verifyPayload);
+	int attach(GaborKernel &kernel);
+	void close(void);
+
+	static int write(const char *path, GaborKernel &kernel, int samplingRate, float sigma, int minF, int maxF);
+	static unsigned __int64 checksum(const void *data, size_t bytes);
+};
@@ -0,0 +1,168 @@
+#include "stdafx.h"
+#include "GaborTableSet.h"
+#include "Convert2ECG.h"
+#include "ErrorStatusNo.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+GaborTableSet::GaborTableSet(void)
+{
+	verbose = false;
+	verify = false;
+}
+
+GaborTableSet::~GaborTableSet(void)
+{
+	std::map<int, tableEntry *>::iterator it;
+	for (it = tables.begin(); it != tables.end(); ++it)
+		delete it->second;
+}
+
+void GaborTableSet::init(std::string exePath, bool verboseMode, bool verifyMode)
+{
+	currentPath = exePath;
+	verbose = verboseMode;
+	verify = verifyMode;
+}
+
+/*
+ Read the G-Table file (44.1/48KHz) into the kernel.
+ */
+int GaborTableSet::loadFile(GaborKernel &kernel, std::string gtblPath)
+{
+	std::ifstream fs;
+
+	fs.open(gtblPath.c_str(), std::ios::in | std::ios::binary);
+	if (fs.fail()) {
+		std::cerr << "Error! cannot open GDataFile:" << gtblPath.c_str() << "\n";
+		return -1;
+	}
+
+	fs.seekg(0, std::ios::end);
+	std::streamsize dataSize = fs.tellg();
+	fs.clear();
+	fs.seekg(0, std::ios::beg);
+
+	gaborFactorTbl *gtbl = (gaborFactorTbl *)malloc((size_t)dataSize);
+	if (!gtbl) {
+		std::cerr << "Error! out of memory. (" << dataSize << ")Byte\n";
+		return -1;
+	}
+
+	fs.read((char *)gtbl, dataSize);
+	if (fs.fail()) {
+		std::cerr << "Error! cannot read GDataFile:" << gtblPath.c_str() << "\n";
+		free(gtbl);
+		return -1;
+	}
+
+	fs.close();
+
+	// split (cos, sin) pairs to the aligned SIMD layout.
+	int err = kernel.build(gtbl->dxlen, gtbl->offset, gtbl->tbl, tbl_size);
+	free(gtbl);
+	if (err) {
+		std::cerr << "Error! out of memory. (Gabor kernel)\n";
+		return -1;
+	}
+
+	return ERR_OK;
+}
+
+int GaborTableSet::setup(tableEntry *entry, int samplingrate)
+{
+	bool hasFile = (samplingrate == SamplingRate441 || samplingrate == SamplingRate480);
+	std::string gtblPath = std::string(currentPath);
+	gtblPath.append((samplingrate == SamplingRate441) ? tblFilePath441 : tblFilePath480);
+	std::string imagePath = std::string(currentPath);
+	if (hasFile) {
+		imagePath.append((samplingrate == SamplingRate441) ? tblImagePath441 : tblImagePath480);
+	}
+	else {
+		std::ostringstream name;
+		name << tblImageName << samplingrate << ".gtb";
+		imagePath.append(name.str());
+	}
+
+	// other rates: scale the factors to the magnitude level of the 48KHz table,
+	// so that thresholdLevel stays valid.
+	entry->level = hasFile ? 1.0F : (float)SamplingRate480 / samplingrate;
+
+	// map the prepared image. (shared with other processes by the file cache)
+	if (entry->file.open(imagePath.c_str(), samplingrate, GaborSigma, tbl_minf, tbl_maxf, verify) == ERR_OK &&
+		entry->file.attach(entry->kernel) == ERR_OK) {
+		if (verbose) {
+			std::cout << "G-Table image:" << imagePath.c_str() << "\n";
+			std::cout << "Gabor kernel:" << entry->kernel.getLevelName() << "\n";
+		}
+		return ERR_OK;
+	}
+	entry->file.close();
+
+	if (!hasFile || loadFile(entry->kernel, gtblPath) != ERR_OK) {
+		int threads = (int)std::thread::hardware_concurrency();
+		if (entry->kernel.generate(samplingrate, GaborSigma, tbl_minf, tbl_size, entry->level, threads)) {
+			std::cerr << "Error! out of memory. (Gabor kernel)\n";
+			return -1;
+		}
+		if (verbose) {
+			std::cout << "G-Table generated:" << samplingrate << "Hz (threads:" << threads << ")\n";
+		}
+	}
+	if (verbose) {
+		std::cout << "Gabor kernel:" << entry->kernel.getLevelName() << "\n";
+	}
+
+	// save the image for the next run.
+	if (GaborTableFile::write(imagePath.c_str(), entry->kernel, samplingrate, GaborSigma, tbl_minf, tbl_maxf) != ERR_OK) {
+		if (verbose)
+			std::cerr << "Warning! cannot write G-Table image:" << imagePath.c_str() << "\n";
+	}
+
+	return ERR_OK;
+}
+
+/*
+ Kernel for the sampling rate, nullptr if it cannot be set up.
+ */
+GaborKernel *GaborTableSet::get(int samplingRate, float *level)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	std::map<int, tableEntry *>::iterator it = tables.find(samplingRate);
+	if (it == tables.end()) {
+		tableEntry *entry = new tableEntry;
+		if (setup(entry, samplingRate) != ERR_OK) {
+			delete entry;
+			return nullptr;
+		}
+		it = tables.insert(std::make_pair(samplingRate, entry)).first;
+	}
+	*level = it->second->level;
+	return &it->second->kernel;
+}
+
+/*
+ 16 bit kernel of a rate already set up by get(), nullptr if out of memory.
+ */
+GaborKernel16 *GaborTableSet::getFixed(int samplingRate)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	std::map<int, tableEntry *>::iterator it = tables.find(samplingRate);
+	if (it == tables.end())
+		return nullptr;
+	tableEntry *entry = it->second;
+	if (!entry->kernel16.isReady()) {
+		if (entry->kernel16.build(entry->kernel))
+			return nullptr;
+		if (verbose) {
+			std::cout << "Gabor kernel:" << entry->kernel16.getLevelName()
+					  << " (" << entry->kernel16.getBytes()/1024 << " KByte)\n";
+		}
+	}
+	return &entry->kernel16;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <string>
+#include "GaborKernel.h"
+#include "GaborKernel16.h"
+#include "GaborTableFile.h"
+
+/*
+ G-Tables by sampling rate.
+
+ A table is set up once on the first request (mapped image, G-Table file or
+ generated) and then used read-only, so one set can be shared by all the
+ converters of a batch.
+ */
+class GaborTableSet
+{
+private:
+	struct tableEntry {
+		GaborTableFile	file;
+		GaborKernel		kernel;
+		GaborKernel16	kernel16;		// quantized on the first getFixed().
+		float			level;			// factor scale. (generated table)
+	};
+	std::map<int, tableEntry *> tables;
+	std::mutex	lock;
+	std::string	currentPath;
+	bool	verbose;
+	bool	verify;						// check the image payload. (-X)
+
+	int loadFile(GaborKernel &kernel, std::string gtblPath);
+	int setup(tableEntry *entry, int samplingRate);
+
+public:
+	GaborTableSet(void);
+	virtual ~GaborTableSet(void);
+
+	void init(std::string exePath, bool verboseMode, bool verifyMode);
+	bool isReady(void) { return !currentPath.empty(); }
+	GaborKernel *get(int samplingRate, float *level);
+	GaborKernel16 *getFixed(int samplingRate);
+};
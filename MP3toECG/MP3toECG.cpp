@@ -4,8 +4,11 @@
 #include "stdafx.h"
 
 #include "Arguments.h"
+#include "BatchConverter.h"
 #include "Convert2ECG.h"
+#include "ConvertServer.h"
 #include "ErrorStatusNo.h"
+#include "ResultCache.h"
 
 namespace ECGConverter {
 	void usage( _TCHAR* exepath )
@@ -17,6 +20,17 @@ namespace ECGConverter {
 		_tprintf(_T("\t-c ignore calibration ERROR\n"));
 		_tprintf(_T("\t-s serialNo (over write serial No)\n"));
 		_tprintf(_T("\t-d startTime (convert only data section)\n"));
+		_tprintf(_T("\t-e engine (data section frequency engine: gabor, sliding, demod, int16)\n"));
+		_tprintf(_T("\t-D (decimate the pcm before the analysis)\n"));
+		_tprintf(_T("\t-T (track the data frequency from the previous sample)\n"));
+		_tprintf(_T("\t-t threads (data section threads)\n"));
+		_tprintf(_T("\t-f (decode mp3 by ffmpeg)\n"));
+		_tprintf(_T("\t-b (batch mode, inputFile: folder, wildcard or list file)\n"));
+		_tprintf(_T("\t-j jobs (batch worker threads)\n"));
+		_tprintf(_T("\t-p (stream wav input, inputFile: pipe or - for stdin)\n"));
+		_tprintf(_T("\t-J (write stage report json)\n"));
+		_tprintf(_T("\t-B (write binary ecg file .ecb)\n"));
+		_tprintf(_T("\t-S (server mode, inputFile: pipe name)\n"));
 	}
 }
 
@@ -30,15 +44,46 @@ int _tmain(int argc, _TCHAR* argv[])
 		return -1;
 	}
 
-	int status = argument.convertToWave();
-	if (status != ERR_OK) {
-		std::cerr << "Error Internal cannot convert MP3 to WAV\n";
-		return -1;
+	if (argument.opt_b) {
+		BatchConverter batch;
+		return batch.run(argument);
+	}
+	if (argument.opt_S) {
+		ConvertServer server;
+		return server.run(argument);
+	}
+
+	ResultCache cache;
+	if (cache.open(argument) == 0) {
+		int status, serialNo;
+		if (cache.fetch(argument, &status, &serialNo) == 0) {
+			if (argument.opt_v)
+				std::cerr << "\n\tcached status:" << status << "\n";
+			return status;
+		}
 	}
 
 	Convert2ECG converter;
+	int status = -1;
+	if (argument.opt_p)
+		status = ERR_OK;						// read while converting.
+	else if (argument.isWaveInput())
+		status = ERR_OK;						// read in place by convert.
+	else if (!argument.opt_f)
+		status = converter.decodeMp3(argument);
+	if (status != ERR_OK) {
+		converter.startStage(StageTimer::StageFfmpeg);
+		status = argument.convertToWave();		// use ffmpeg.
+		converter.stopStage(StageTimer::StageFfmpeg);
+		if (status != ERR_OK) {
+			std::cerr << "Error Internal cannot convert MP3 to WAV\n";
+			return -1;
+		}
+	}
+
 	status = converter.convert(argument);
 	converter.outStatus(argument, status);
+	cache.store(argument, status, converter.getSerialNo());
 
 	argument.delteWaveFile();
 
@@ -0,0 +1,216 @@
+#include "stdafx.h"
+#include "Mp3Decoder.h"
+
+#include <Windows.h>
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma comment(lib, "ole32.lib")
+#pragma comment(lib, "mfplat.lib")
+#pragma comment(lib, "mfreadwrite.lib")
+#pragma comment(lib, "mfuuid.lib")
+
+Mp3Decoder::Mp3Decoder(void)
+{
+	pcm = nullptr;
+	for (int c=0; c<kMaxChannels; c++)
+		channelPcm[c] = nullptr;
+	samples = 0;
+	capacity = 0;
+	padding = 0;
+	samplingRate = 0;
+	channels = 0;
+}
+
+Mp3Decoder::~Mp3Decoder(void)
+{
+	if (pcm)	free(pcm);
+	for (int c=0; c<kMaxChannels; c++) {
+		if (channelPcm[c])	free(channelPcm[c]);
+	}
+}
+
+int Mp3Decoder::reserve(int count)
+{
+	int need = padding + samples + count + padding;
+	if (need <= capacity)
+		return 0;
+
+	int newCapacity = (capacity > 0) ? capacity : samplingRate * 60;
+	while (newCapacity < need)
+		newCapacity *= 2;
+	float *p = (float *)realloc(pcm, newCapacity * sizeof(float));
+	if (!p)
+		return -1;
+	pcm = p;
+	if (channels > 1 && channels <= kMaxChannels) {
+		for (int c=0; c<channels; c++) {
+			p = (float *)realloc(channelPcm[c], newCapacity * sizeof(float));
+			if (!p)
+				return -1;
+			channelPcm[c] = p;
+		}
+	}
+	capacity = newCapacity;
+	return 0;
+}
+
+int Mp3Decoder::decode(const char *mp3Path)
+{
+	IMFSourceReader *reader = nullptr;
+	IMFMediaType *type = nullptr;
+	wchar_t wpath[_MAX_PATH];
+	int err = -1;
+
+	HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	HRESULT hr = MFStartup(MF_VERSION, MFSTARTUP_LITE);
+	if (FAILED(hr)) {
+		if (SUCCEEDED(hrCom))	CoUninitialize();
+		return -1;
+	}
+
+	MultiByteToWideChar(CP_ACP, 0, mp3Path, -1, wpath, _MAX_PATH);
+	hr = MFCreateSourceReaderFromURL(wpath, NULL, &reader);
+	if (SUCCEEDED(hr))
+		hr = reader->SetStreamSelection((DWORD)MF_SOURCE_READER_ALL_STREAMS, FALSE);
+	if (SUCCEEDED(hr))
+		hr = reader->SetStreamSelection((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, TRUE);
+
+	// request 32-bit float PCM at the native sampling rate.
+	if (SUCCEEDED(hr))
+		hr = MFCreateMediaType(&type);
+	if (SUCCEEDED(hr))
+		hr = type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
+	if (SUCCEEDED(hr))
+		hr = type->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_Float);
+	if (SUCCEEDED(hr))
+		hr = reader->SetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, NULL, type);
+	if (type) {
+		type->Release();
+		type = nullptr;
+	}
+	if (SUCCEEDED(hr))
+		hr = reader->GetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, &type);
+
+	UINT32 rate = 0, nch = 0;
+	if (SUCCEEDED(hr))
+		hr = type->GetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, &rate);
+	if (SUCCEEDED(hr))
+		hr = type->GetUINT32(MF_MT_AUDIO_NUM_CHANNELS, &nch);
+	if (type)
+		type->Release();
+
+	if (SUCCEEDED(hr) && rate > 0 && nch > 0) {
+		samplingRate = (int)rate;
+		channels = (int)nch;
+		padding = samplingRate/2;
+		samples = 0;
+		err = 0;
+
+		while (err == 0) {
+			DWORD flags = 0;
+			IMFSample *sample = nullptr;
+			hr = reader->ReadSample((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, NULL, &flags, NULL, &sample);
+			if (FAILED(hr)) {
+				err = -1;
+				break;
+			}
+			if (flags & MF_SOURCE_READERF_ENDOFSTREAM) {
+				if (sample)	sample->Release();
+				break;
+			}
+			if (!sample)
+				continue;
+
+			IMFMediaBuffer *buffer = nullptr;
+			BYTE *data = nullptr;
+			DWORD bytes = 0;
+			hr = sample->ConvertToContiguousBuffer(&buffer);
+			if (SUCCEEDED(hr))
+				hr = buffer->Lock(&data, NULL, &bytes);
+			if (SUCCEEDED(hr)) {
+				const float *src = (const float *)data;
+				int frames = bytes / (sizeof(float) * channels);
+				if (reserve(frames) == 0) {
+					float *dst = &pcm[padding + samples];
+					if (channels == 1) {
+						memcpy(dst, src, frames * sizeof(float));
+					}
+					else if (channels <= kMaxChannels) {
+						// down mix, and each channel.
+						float scale = 1.0F / channels;
+						for (int i=0; i<frames; i++) {
+							float sum = 0.0F;
+							for (int c=0; c<channels; c++) {
+								channelPcm[c][padding + samples + i] = *src;
+								sum += *src++;
+							}
+							*dst++ = sum * scale;
+						}
+					}
+					else {
+						// down mix. (same as ffmpeg -ac 1)
+						float scale = 1.0F / channels;
+						for (int i=0; i<frames; i++) {
+							float sum = 0.0F;
+							for (int c=0; c<channels; c++)
+								sum += *src++;
+							*dst++ = sum * scale;
+						}
+					}
+					samples += frames;
+				}
+				else {
+					err = -1;
+				}
+				buffer->Unlock();
+			}
+			else {
+				err = -1;
+			}
+			if (buffer)	buffer->Release();
+			sample->Release();
+		}
+	}
+
+	if (reader)
+		reader->Release();
+	MFShutdown();
+	if (SUCCEEDED(hrCom))
+		CoUninitialize();
+
+	if (err == 0 && (samples == 0 || reserve(0)))
+		err = -1;
+	if (err == 0) {
+		memset(pcm, 0, padding * sizeof(float));
+		memset(&pcm[padding + samples], 0, padding * sizeof(float));
+		for (int c=0; c<kMaxChannels; c++) {
+			if (!channelPcm[c])
+				continue;
+			memset(channelPcm[c], 0, padding * sizeof(float));
+			memset(&channelPcm[c][padding + samples], 0, padding * sizeof(float));
+		}
+	}
+	return err;
+}
+
+float *Mp3Decoder::detach(int *length)
+{
+	float *p = pcm;
+	*length = padding + samples + padding;
+	pcm = nullptr;
+	capacity = 0;
+	return p;
+}
+
+float *Mp3Decoder::detachChannel(int ch)
+{
+	if (ch < 0 || ch >= kMaxChannels)
+		return nullptr;
+	float *p = channelPcm[ch];
+	channelPcm[ch] = nullptr;
+	return p;
+}
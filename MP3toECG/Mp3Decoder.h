@@ -0,0 +1,38 @@
+#pragma once
+
+/*
+ In-process MP3 decoder (Media Foundation Source Reader).
+
+ The file is decoded to 32-bit float, down mixed to monaural and written
+ straight into a PCM buffer that has 'padding' silent samples in front of
+ and behind the data, the layout Convert2ECG uses for pcmdata. Up to
+ kMaxChannels channels are also kept one by one in the same layout for the
+ channel selection of Convert2ECG.
+ */
+class Mp3Decoder
+{
+public:
+	static const int kMaxChannels = 8;
+
+private:
+	float	*pcm;
+	float	*channelPcm[kMaxChannels];		// each channel. (channels > 1)
+	int		samples;						// decoded samples (without padding)
+	int		capacity;						// allocated samples
+	int		padding;
+	int		samplingRate;
+	int		channels;
+
+	int reserve(int count);
+
+public:
+	Mp3Decoder(void);
+	virtual ~Mp3Decoder(void);
+
+	int decode(const char *mp3Path);
+	float *detach(int *length);				// caller frees the buffer.
+	float *detachChannel(int ch);			// nullptr: mono or too many channels.
+	int getSamplingRate(void) { return samplingRate; }
+	int getChannels(void) { return channels; }
+	int getSamples(void) { return samples; }
+};
@@ -0,0 +1,123 @@
+#include "stdafx.h"
+#include "OutputFile.h"
+#include "ErrorStatusNo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <Windows.h>
+
+const char OutputFile::kBinaryMagic[4] = { 'E', 'C', 'G', 'B' };
+
+OutputFile::OutputFile(void)
+{
+	buf = nullptr;
+	length = 0;
+	capacity = 0;
+	newline = "\r\n";
+	failed = false;
+}
+
+OutputFile::~OutputFile(void)
+{
+	if (buf)	free(buf);
+}
+
+bool OutputFile::reserve(int count)
+{
+	if (failed)
+		return false;
+	if (length + count <= capacity)
+		return true;
+
+	int newCapacity = (capacity > 0) ? capacity : kInitialCapacity;
+	while (newCapacity < length + count)
+		newCapacity *= 2;
+	char *p = (char *)realloc(buf, newCapacity);
+	if (!p) {
+		failed = true;
+		return false;
+	}
+	buf = p;
+	capacity = newCapacity;
+	return true;
+}
+
+OutputFile &OutputFile::put(const char *str)
+{
+	return putBytes(str, (int)strlen(str));
+}
+
+OutputFile &OutputFile::put(long long val)
+{
+	char digits[24];
+	int n = 0;
+	unsigned long long u = (val < 0) ? 0ULL - (unsigned long long)val : (unsigned long long)val;
+	do {
+		digits[n++] = (char)('0' + u % 10);
+		u /= 10;
+	} while (u);
+	if (!reserve(n + 1))
+		return *this;
+	if (val < 0)
+		buf[length++] = '-';
+	while (n > 0)
+		buf[length++] = digits[--n];
+	return *this;
+}
+
+OutputFile &OutputFile::putFixed(double val)
+{
+	char str[64];
+	sprintf_s(str, sizeof(str), "%.3f", val);
+	return put(str);
+}
+
+OutputFile &OutputFile::putBytes(const void *data, int count)
+{
+	if (count <= 0 || !reserve(count))
+		return *this;
+	memcpy(&buf[length], data, count);
+	length += count;
+	return *this;
+}
+
+OutputFile &OutputFile::putVarint(unsigned int val)
+{
+	if (!reserve(5))
+		return *this;
+	while (val >= 0x80) {
+		buf[length++] = (char)(val | 0x80);
+		val >>= 7;
+	}
+	buf[length++] = (char)val;
+	return *this;
+}
+
+/*
+ Write the buffer to path. (temporary file and rename)
+ The temporary name has the thread id too, batch workers and server
+ sessions of one process may commit the same path at a time.
+ */
+int OutputFile::commit(const char *path)
+{
+	if (failed)
+		return -1;
+
+	std::ostringstream tmp;
+	tmp << path << "." << GetCurrentProcessId() << "." << GetCurrentThreadId() << ".tmp";
+	std::ofstream fs;
+	fs.open(tmp.str().c_str(), std::ios::out | std::ios::binary);
+	if (fs.fail())
+		return -1;
+	if (length > 0)
+		fs.write(buf, length);
+	fs.close();
+	if (fs.fail() || !MoveFileExA(tmp.str().c_str(), path, MOVEFILE_REPLACE_EXISTING)) {
+		remove(tmp.str().c_str());
+		return -1;
+	}
+	return ERR_OK;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ Output file built in memory. (.ecg, .rst, .json)
+
+ The text is formatted into one growing buffer and written by a single
+ write() to a temporary file, which is then renamed to the path. A reader
+ of ECGPATH never sees a partial file, and a network drive gets one large
+ write instead of a write per line. Lines end with CR LF as the text mode
+ streams wrote them.
+
+ The binary ECG file (-B) uses the varint helpers:
+
+   "ECGB" | version (1 byte) | header length (varint) | header text
+   | samples (varint) | zigzag varint of (value - previous value) ...
+
+ The header text is the .ecg text up to "[ECG Event1]" with LF line ends
+ (empty with -r), the values are the ones of the text file, the previous
+ value of the first sample is 0.
+ */
+class OutputFile
+{
+private:
+	static const int kInitialCapacity = 64 * 1024;
+
+	char	*buf;
+	int		length;
+	int		capacity;
+	const char *newline;
+	bool	failed;							// out of memory.
+
+	bool reserve(int count);
+
+public:
+	static const char kBinaryMagic[4];
+	static const int kBinaryVersion = 1;
+
+	OutputFile(void);
+	virtual ~OutputFile(void);
+
+	void setNewline(const char *nl) { newline = nl; }
+	OutputFile &put(const char *str);
+	OutputFile &put(long long val);
+	OutputFile &putFixed(double val);		// 3 decimals.
+	OutputFile &endl(void) { return put(newline); }
+	OutputFile &putBytes(const void *data, int count);
+	OutputFile &putVarint(unsigned int val);
+	OutputFile &putZigzag(int val) { return putVarint(((unsigned int)val << 1) ^ (unsigned int)(val >> 31)); }
+
+	const char *getData(void) { return buf; }
+	int getLength(void) { return length; }
+	int commit(const char *path);
+};
@@ -0,0 +1,237 @@
+#include "stdafx.h"
+#include "PcmStream.h"
+#include "WaveFormat.h"
+
+#include <fcntl.h>
+#include <io.h>
+#include <iostream>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+PcmStream::PcmStream(void)
+{
+	fp = nullptr;
+	ownFile = false;
+	samplingRate = 0;
+	padding = 0;
+	history = 0;
+	reach = 0;
+	buf = nullptr;
+	readBuf = nullptr;
+	capacity = 0;
+	readSize = 0;
+	base = 0;
+	filled = 0;
+	dataEnd = -1;
+	dataBytes = -1;
+}
+
+PcmStream::~PcmStream(void)
+{
+	if (buf)		free(buf);
+	if (readBuf)	free(readBuf);
+	if (fp && ownFile)	fclose(fp);
+}
+
+int PcmStream::open(const char *path)
+{
+	if (strcmp(path, "-") == 0) {
+		_setmode(_fileno(stdin), _O_BINARY);
+		fp = stdin;
+		ownFile = false;
+	}
+	else {
+		if (fopen_s(&fp, path, "rb") != 0)
+			fp = nullptr;
+		ownFile = true;
+	}
+	if (!fp) {
+		std::cerr << "Error! cannot open input stream:" << path << "\n";
+		return -1;
+	}
+	return readHeader();
+}
+
+/*
+ Read through bytes. (a pipe cannot seek) -1: short read.
+ */
+int PcmStream::skip(unsigned __int64 bytes)
+{
+	char tmp[256];
+
+	while (bytes > 0) {
+		size_t n = (bytes < sizeof(tmp)) ? (size_t)bytes : sizeof(tmp);
+		if (fread(tmp, 1, n, fp) != n)
+			return -1;
+		bytes -= n;
+	}
+	return 0;
+}
+
+/*
+ Read the chunks up to the top of 'data'. other chunks are read through.
+ (word aligned) the size of 'data' may be unknown. (0 or 0xffffffff)
+ */
+int PcmStream::readHeader(void)
+{
+	_chankHeader chk;
+
+	while (1) {
+		if (fread(&chk, sizeof(chk), 1, fp) != 1) {
+			std::cerr << "Error! wav stream is broken.\n";
+			return -1;
+		}
+		if (chk.chankIdVal == CHANK_RIFF) {
+			__int32 tagWave;
+			if (fread(&tagWave, sizeof(tagWave), 1, fp) != 1 || tagWave != CHANK_WAVE) {
+				std::cerr << "Error! wav stream is not 'WAVE' format\n";
+				return -1;
+			}
+		}
+		else if (chk.chankIdVal == CHANK_fmt) {
+			_fmtChunk fmt;
+			unsigned __int32 size = (unsigned __int32)chk.chankSize;
+			memset(&fmt, 0, sizeof(fmt));
+			if (size < sizeof(fmt)) {
+				std::cerr << "Error! 'fmt ' chank size is worng:" << chk.chankSize << "\n";
+				return -1;
+			}
+			if (fread(&fmt, sizeof(fmt), 1, fp) != 1 || skip((unsigned __int64)size - sizeof(fmt) + (size & 1))) {
+				std::cerr << "Error! wav stream is broken.\n";
+				return -1;
+			}
+			if (fmt.wFormatTag != 1 || fmt.wChannels != 1 || fmt.wBitsPerSample != 16) {
+				std::cerr << "Error! wav stream is not 16bits MONORAL Linear PCM\n";
+				return -1;
+			}
+			samplingRate = fmt.dwSamplesPerSec;
+		}
+		else if (chk.chankIdVal == CHANK_data) {
+			unsigned __int32 size = (unsigned __int32)chk.chankSize;
+			dataBytes = (size == 0 || size == 0xffffffff) ? -1 : (__int64)size;
+			break;
+		}
+		else {
+			// onother chank! read through.
+			unsigned __int32 size = (unsigned __int32)chk.chankSize;
+			if (skip((unsigned __int64)size + (size & 1))) {
+				std::cerr << "Error! wav stream is broken.\n";
+				return -1;
+			}
+		}
+	}
+
+	if (samplingRate == 0) {
+		std::cerr << "Error! wav stream has no 'fmt ' chank.\n";
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ Allocate the window. the first samples are the silent padding.
+ */
+int PcmStream::setup(int historySamples, int reachSamples)
+{
+	padding = samplingRate/2;
+	history = historySamples;
+	reach = reachSamples;
+	readSize = samplingRate/4;
+	capacity = history + reach + readSize + padding;
+
+	buf = (float *)malloc(capacity * sizeof(float));
+	readBuf = (__int16 *)malloc(readSize * sizeof(__int16));
+	if (!buf || !readBuf)
+		return -1;
+
+	memset(buf, 0, padding * sizeof(float));
+	base = 0;
+	filled = padding;
+	return 0;
+}
+
+/*
+ Read until the sample endIdx is in the window, the window is full, or the
+ end of the stream. returns the number of samples added, -1: read error.
+ */
+int PcmStream::fill(int endIdx)
+{
+	int added = 0;
+
+	while (base + filled < endIdx && filled < capacity) {
+		int n;
+		if (dataEnd >= 0) {
+			// end of data: silent padding.
+			n = endIdx - (base + filled);
+			if (n > dataEnd + padding - (base + filled))
+				n = dataEnd + padding - (base + filled);
+			if (n > capacity - filled)
+				n = capacity - filled;
+			if (n <= 0)
+				break;
+			memset(&buf[filled], 0, n * sizeof(float));
+			filled += n;
+			added += n;
+			continue;
+		}
+
+		n = readSize;
+		if (n > capacity - filled)
+			n = capacity - filled;
+		if (dataBytes >= 0 && n > dataBytes/2)
+			n = (int)(dataBytes/2);
+		int got = (n > 0) ? (int)fread(readBuf, sizeof(__int16), n, fp) : 0;
+		if (got < n && ferror(fp)) {
+			std::cerr << "Error! cannot read wav stream.\n";
+			return -1;
+		}
+		for (int i=0; i<got; i++)
+			buf[filled + i] = (float)readBuf[i] / (float)SHRT_MAX;
+		filled += got;
+		added += got;
+		if (dataBytes >= 0)
+			dataBytes -= got * sizeof(__int16);
+		if (got < n || dataBytes == 0)
+			dataEnd = base + filled;
+	}
+	return added;
+}
+
+/*
+ Window around the sample idx to *pcm. the kernel reads [idx-reach, idx+reach).
+ up to 'history' samples behind the latest position can be requested again.
+ 1: beyond the padding after the data. -1: out of the history or read error,
+ not the end of the data. (reported)
+ */
+int PcmStream::window(int idx, float **pcm)
+{
+	*pcm = nullptr;
+	if (idx - reach < base) {
+		std::cerr << "Error! stream position is out of the history:" << idx << "\n";
+		return -1;
+	}
+
+	int endIdx = idx + reach;
+	while (endIdx > base + filled) {
+		// drop the samples behind the history.
+		int drop = idx - history - base;
+		if (drop > filled)
+			drop = filled;
+		if (drop > 0) {
+			memmove(buf, &buf[drop], (filled - drop) * sizeof(float));
+			base += drop;
+			filled -= drop;
+		}
+		int added = fill(endIdx);
+		if (added < 0)
+			return -1;
+		if (added == 0)
+			break;
+	}
+
+	if (endIdx > base + filled)
+		return 1;
+	*pcm = &buf[idx - base];
+	return 0;
+}
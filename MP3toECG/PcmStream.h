@@ -0,0 +1,48 @@
+#pragma once
+#include <stdio.h>
+
+/*
+ Streaming PCM input. (-p)
+
+ A WAV stream (16-bit linear PCM, monaural, e.g. "ffmpeg ... -f wav -") is
+ read from stdin or a pipe incrementally. Only a window around the current
+ analysis position is kept: 'history' samples behind it for the stages that
+ step back (header re-detection), 'reach' samples on both sides of any
+ requested position for the Gabor kernel. Sample indexes are the same as pcmdata, with samplingRate/2
+ silent samples in front of and behind the data.
+ */
+class PcmStream
+{
+private:
+	FILE	*fp;
+	bool	ownFile;
+	int		samplingRate;
+	int		padding;
+	int		history;
+	int		reach;
+
+	float	*buf;
+	__int16	*readBuf;
+	int		capacity;						// samples in buf.
+	int		readSize;						// samples per read.
+	int		base;							// sample index of buf[0]
+	int		filled;							// valid samples in buf.
+	int		dataEnd;						// index after the last data sample. (-1: not yet)
+	__int64	dataBytes;						// remaining bytes of 'data' chunk. (-1: unknown)
+
+	int readHeader(void);
+	int skip(unsigned __int64 bytes);
+	int fill(int endIdx);
+
+public:
+	PcmStream(void);
+	virtual ~PcmStream(void);
+
+	int open(const char *path);				// "-": stdin
+	int setup(int historySamples, int reachSamples);
+	int window(int idx, float **pcm);		// 0: ok, 1: beyond the data, -1: error.
+	bool isEnded(void) { return dataEnd >= 0; }
+	int getSamplingRate(void) { return samplingRate; }
+	int getSamples(void) { return (dataEnd < 0) ? base + filled - padding : dataEnd - padding; }
+	int getCapacity(void) { return capacity; }
+};
@@ -0,0 +1,301 @@
+#include "stdafx.h"
+#include "ResultCache.h"
+#include "GaborTableFile.h"
+#include "OutputFile.h"
+#include "ErrorStatusNo.h"
+
+#include <Windows.h>
+#include <sys/utime.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+
+#define EXT_CACHEFILE ".cache"
+
+const char ResultCache::kMagic[4] = { 'E', 'C', 'G', 'R' };
+
+ResultCache::ResultCache(void)
+{
+	maxBytes = 0;
+	enabled = false;
+	key = 0;
+	inputBytes = 0;
+}
+
+ResultCache::~ResultCache(void)
+{
+}
+
+/*
+ Key of the input file of the arguments. -1: the cache is not used.
+ The file is hashed from a read-only mapping, not read into memory.
+ */
+int ResultCache::open(Arguments &arg)
+{
+	if (arg.cacheFolder.empty() || arg.opt_p)
+		return -1;
+
+	char path[_MAX_PATH];
+	arg.getMp3FilePath(path, sizeof(path));
+	HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return -1;
+
+	int ret = -1;
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(hFile, &size) && size.QuadPart > 0) {
+		HANDLE hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (hMap) {
+			const void *view = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+			if (view) {
+				ret = open(arg, view, (size_t)size.QuadPart);
+				UnmapViewOfFile(view);
+			}
+			CloseHandle(hMap);
+		}
+	}
+	CloseHandle(hFile);
+	return ret;
+}
+
+int ResultCache::open(Arguments &arg, const void *input, size_t bytes)
+{
+	enabled = false;
+	if (arg.cacheFolder.empty() || arg.opt_X || arg.opt_J || arg.cacheSizeMB <= 0)
+		return -1;							// -J: the report is of this run.
+
+	// options that change the output file. (not -v -t -j -J)
+	char text[256];
+	sprintf_s(text, sizeof(text), "c%d s%d d%.6f r%d w%d e%d D%d T%d f%d B%d table%d cache%d",
+		arg.opt_c, arg.owSerialNo, arg.donlyStartTime, arg.opt_r, arg.opt_w,
+		arg.engine, arg.opt_D, arg.opt_T, arg.opt_f, arg.opt_B, GaborTableFile::kVersion, kVersion);
+
+	folder = arg.cacheFolder;
+	maxBytes = (long long)arg.cacheSizeMB * 1024 * 1024;
+	keyText = std::string(text);
+	inputBytes = (long long)bytes;
+	key = hash(input, bytes, 0xcbf29ce484222325ULL);
+	key = hash(keyText.data(), keyText.length(), key);
+	enabled = true;
+	return 0;
+}
+
+/*
+ FNV-1a, 8 bytes a step.
+ */
+unsigned __int64 ResultCache::hash(const void *data, size_t bytes, unsigned __int64 h)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	size_t words = bytes / 8;
+
+	for (size_t i=0; i<words; i++) {
+		unsigned __int64 w;
+		memcpy(&w, p + i*8, 8);
+		h ^= w;
+		h *= 0x100000001b3ULL;
+	}
+	for (size_t i=words*8; i<bytes; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	h ^= (unsigned __int64)bytes;
+	h *= 0x100000001b3ULL;
+	return h;
+}
+
+std::string ResultCache::getEntryPath(void)
+{
+	char name[32];
+	sprintf_s(name, sizeof(name), "%016llx", (unsigned long long)key);
+	return folder + name + EXT_CACHEFILE;
+}
+
+bool ResultCache::readFile(const char *path, std::vector<char> &data)
+{
+	std::ifstream fs(path, std::ios::in | std::ios::binary);
+	if (fs.fail())
+		return false;
+	fs.seekg(0, std::ios::end);
+	std::streamoff size = fs.tellg();
+	fs.seekg(0, std::ios::beg);
+	if (size < 0)
+		return false;
+	data.resize((size_t)size);
+	if (size > 0)
+		fs.read(&data[0], size);
+	return !fs.fail();
+}
+
+static bool getVarint(const std::vector<char> &data, size_t &pos, unsigned int *val)
+{
+	unsigned int v = 0;
+	for (int shift=0; shift<35; shift+=7) {
+		if (pos >= data.size())
+			return false;
+		unsigned char c = (unsigned char)data[pos++];
+		v |= (unsigned int)(c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			*val = v;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ Write the stored output files. 0: hit, -1: miss.
+ On a miss the old output files are removed, so store() sees only the
+ files of this run.
+ */
+int ResultCache::fetch(Arguments &arg, int *status, int *serialNo)
+{
+	if (!enabled)
+		return -1;
+	if (restore(arg, status, serialNo) == 0)
+		return 0;
+
+	char path[_MAX_PATH];
+	if (arg.opt_B)
+		arg.getBinaryPath(path, sizeof(path));
+	else
+		arg.getEcgFilePath(path, sizeof(path));
+	remove(path);
+	arg.getStatusPath(path, sizeof(path));
+	remove(path);
+	return -1;
+}
+
+int ResultCache::restore(Arguments &arg, int *status, int *serialNo)
+{
+
+	std::string path = getEntryPath();
+	std::vector<char> data;
+	if (!readFile(path.c_str(), data) || data.size() < sizeof(kMagic) + 1)
+		return -1;
+	if (memcmp(&data[0], kMagic, sizeof(kMagic)) != 0 || data[sizeof(kMagic)] != kVersion)
+		return -1;
+
+	size_t pos = sizeof(kMagic) + 1;
+	unsigned int size, textLen, zzStatus, zzSerial, ecgLen, rstLen;
+	if (!getVarint(data, pos, &size) || size != (unsigned int)inputBytes)
+		return -1;
+	if (!getVarint(data, pos, &textLen) || pos + textLen > data.size()
+		|| keyText.compare(0, std::string::npos, &data[pos], textLen) != 0)
+		return -1;
+	pos += textLen;
+	if (!getVarint(data, pos, &zzStatus) || !getVarint(data, pos, &zzSerial))
+		return -1;
+	if (!getVarint(data, pos, &ecgLen) || pos + ecgLen > data.size())
+		return -1;
+	size_t ecgPos = pos;
+	pos += ecgLen;
+	if (!getVarint(data, pos, &rstLen) || pos + rstLen != data.size())
+		return -1;
+	size_t rstPos = pos;
+
+	char ecgPath[_MAX_PATH];
+	char rstPath[_MAX_PATH];
+	if (arg.opt_B)
+		arg.getBinaryPath(ecgPath, sizeof(ecgPath));
+	else
+		arg.getEcgFilePath(ecgPath, sizeof(ecgPath));
+	arg.getStatusPath(rstPath, sizeof(rstPath));
+
+	OutputFile ecg;
+	OutputFile rst;
+	ecg.putBytes(&data[ecgPos], ecgLen);
+	rst.putBytes(&data[rstPos], rstLen);
+	if (ecg.commit(ecgPath) || rst.commit(rstPath))
+		return -1;
+
+	touch(path);
+	*status = (int)(zzStatus >> 1) ^ -(int)(zzStatus & 1);
+	*serialNo = (int)(zzSerial >> 1) ^ -(int)(zzSerial & 1);
+	return 0;
+}
+
+/*
+ Save the output files just written. A failed conversion is not stored:
+ it writes no .ecg, and it is tried again next time.
+ */
+void ResultCache::store(Arguments &arg, int status, int serialNo)
+{
+	if (!enabled || status != ERR_OK)
+		return;
+
+	char ecgPath[_MAX_PATH];
+	char rstPath[_MAX_PATH];
+	if (arg.opt_B)
+		arg.getBinaryPath(ecgPath, sizeof(ecgPath));
+	else
+		arg.getEcgFilePath(ecgPath, sizeof(ecgPath));
+	arg.getStatusPath(rstPath, sizeof(rstPath));
+
+	std::vector<char> ecg;
+	std::vector<char> rst;
+	if (!readFile(ecgPath, ecg) || !readFile(rstPath, rst))
+		return;							// no output. (error before the data)
+
+	OutputFile out;
+	char version = kVersion;
+	out.putBytes(kMagic, sizeof(kMagic)).putBytes(&version, 1);
+	out.putVarint((unsigned int)inputBytes);
+	out.putVarint((unsigned int)keyText.length()).putBytes(keyText.data(), (int)keyText.length());
+	out.putZigzag(status).putZigzag(serialNo);
+	out.putVarint((unsigned int)ecg.size());
+	if (!ecg.empty())
+		out.putBytes(&ecg[0], (int)ecg.size());
+	out.putVarint((unsigned int)rst.size());
+	if (!rst.empty())
+		out.putBytes(&rst[0], (int)rst.size());
+
+	CreateDirectoryA(folder.c_str(), NULL);		// fails if it exists.
+	if (out.commit(getEntryPath().c_str()))
+		return;
+	evict();
+}
+
+void ResultCache::touch(const std::string &path)
+{
+	_utime(path.c_str(), NULL);			// now.
+}
+
+/*
+ Remove the least recently used entries while the folder is over the limit.
+ */
+void ResultCache::evict(void)
+{
+	struct entry {
+		unsigned __int64 time;
+		long long	size;
+		std::string	name;
+		bool operator<(const entry &e) const { return time < e.time; }
+	};
+	std::vector<entry> entries;
+	long long total = 0;
+
+	WIN32_FIND_DATAA fd;
+	HANDLE hFind = FindFirstFileA((folder + "*" + EXT_CACHEFILE).c_str(), &fd);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return;
+	do {
+		if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		entry e;
+		e.time = ((unsigned __int64)fd.ftLastWriteTime.dwHighDateTime << 32) | fd.ftLastWriteTime.dwLowDateTime;
+		e.size = ((long long)fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+		e.name = std::string(fd.cFileName);
+		total += e.size;
+		entries.push_back(e);
+	} while (FindNextFileA(hFind, &fd));
+	FindClose(hFind);
+
+	if (total <= maxBytes)
+		return;
+	std::sort(entries.begin(), entries.end());
+	for (size_t i=0; i<entries.size() && total > maxBytes; i++) {
+		remove((folder + entries[i].name).c_str());
+		total -= entries[i].size;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "Arguments.h"
+
+/*
+ Result cache of the conversions. (CACHEFOLDER / CACHESIZE of the config)
+
+ The same MP3 is often converted again (re-upload, retry after a failure
+ downstream). The key is a hash of the input bytes and of the options that
+ change the output, so a hit writes the stored .ecg (.ecb) and .rst without
+ decoding or analyzing anything. One entry is one file in the cache folder:
+
+   "ECGR" | version (1 byte) | input bytes (varint) | key text length (varint)
+   | key text | status (zigzag varint) | serial no. (zigzag varint)
+   | ecg length (varint) | ecg | rst length (varint) | rst
+
+ The input size and the key text (options, table version) are checked at
+ fetch as well, the hash is 64bit FNV-1a. Only successful conversions are
+ stored, and -J (report of this run) does not use the cache. A hit
+ refreshes the file time, and a store removes
+ the oldest entries while the folder is over CACHESIZE (least recently
+ used first). Concurrent processes may share the folder: the entries are
+ written by rename, and a lost entry is only a miss.
+ */
+class ResultCache
+{
+private:
+	static const int kVersion = 1;
+	static const char kMagic[4];
+
+	std::string	folder;
+	long long	maxBytes;
+	bool	enabled;
+	unsigned __int64 key;
+	std::string	keyText;
+	long long	inputBytes;
+
+	std::string getEntryPath(void);
+	int restore(Arguments &arg, int *status, int *serialNo);
+	void touch(const std::string &path);
+	void evict(void);
+	static bool readFile(const char *path, std::vector<char> &data);
+	static unsigned __int64 hash(const void *data, size_t bytes, unsigned __int64 h);
+
+public:
+	ResultCache(void);
+	virtual ~ResultCache(void);
+
+	int open(Arguments &arg);
+	int open(Arguments &arg, const void *input, size_t bytes);
+	bool isEnabled(void) { return enabled; }
+	int fetch(Arguments &arg, int *status, int *serialNo);
+	void store(Arguments &arg, int status, int serialNo);
+};
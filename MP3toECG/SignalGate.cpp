@@ -0,0 +1,82 @@
+#include "stdafx.h"
+#include "SignalGate.h"
+
+#include <emmintrin.h>
+#include <math.h>
+#include <stdlib.h>
+
+SignalGate::SignalGate(void)
+{
+	pcmBase = nullptr;
+	pcmLength = 0;
+	blocks = 0;
+	prefix = nullptr;
+	reach = 0;
+	limit = 0.0;
+	deadBlocks = 0;
+}
+
+SignalGate::~SignalGate(void)
+{
+	release();
+}
+
+void SignalGate::release(void)
+{
+	if (prefix)	free(prefix);
+	prefix = nullptr;
+	blocks = 0;
+}
+
+/*
+ threshold: fvconvert peak level. the bound is kept at half of it, so the
+ float rounding stays on the safe side.
+ */
+int SignalGate::build(const float *pcm, int length, GaborKernel &kernel, int kernelBaseF, float threshold)
+{
+	const int blockLen = 1 << kBlockShift;
+
+	release();
+	pcmBase = pcm;
+	pcmLength = length;
+	blocks = length >> kBlockShift;
+	prefix = (double *)malloc((blocks + 1) * sizeof(double));
+	if (!prefix)
+		return -1;
+
+	// largest magnitude per unit window energy: sqrt(freq * row energy)
+	double gain = 0.0;
+	for (int r=0; r<kernel.getRows(); r++) {
+		const float *re = kernel.getRe(r);
+		const float *im = kernel.getIm(r);
+		double energy = 0.0;
+		for (int m=0; m<kernel.getPadlen(r); m++)
+			energy += (double)re[m]*re[m] + (double)im[m]*im[m];
+		double g = sqrt((kernelBaseF + r) * energy);
+		if (g > gain)
+			gain = g;
+	}
+	reach = kernel.getReach() + kMargin;
+	limit = (gain > 0.0) ? (0.5*threshold/gain) * (0.5*threshold/gain) : 0.0;
+
+	// block energy. (SSE2, 32 samples = 8 vectors)
+	prefix[0] = 0.0;
+	for (int b=0; b<blocks; b++) {
+		const float *p = &pcm[b << kBlockShift];
+		__m128 acc = _mm_setzero_ps();
+		for (int m=0; m<blockLen; m+=4) {
+			__m128 v = _mm_loadu_ps(&p[m]);
+			acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+		}
+		float sum[4];
+		_mm_storeu_ps(sum, acc);
+		prefix[b+1] = prefix[b] + ((double)sum[0] + sum[1] + sum[2] + sum[3]);
+	}
+
+	deadBlocks = 0;
+	for (int b=0; b<blocks; b++) {
+		if (isDead(&pcm[(b << kBlockShift) + blockLen/2]))
+			deadBlocks++;
+	}
+	return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "GaborKernel.h"
+
+/*
+ Energy pre-gate of the Gabor frequency search.
+
+ By the Cauchy-Schwarz inequality a Gabor magnitude is bounded by
+ sqrt(window energy) * sqrt(row energy of the G-Table) * (weight of the
+ row), so where the PCM energy around a position is too small for any row
+ to reach thresholdLevel, fvconvert() cannot find a peak and returns -1
+ without computing the transform. Block energies are summed once over the
+ whole buffer; a query is two prefix sum reads.
+ */
+class SignalGate
+{
+private:
+	static const int kBlockShift = 5;		// 32 samples per block.
+	static const int kMargin = 64;			// samples added to the kernel reach.
+
+	const float *pcmBase;
+	int		pcmLength;
+	int		blocks;
+	double	*prefix;						// [blocks+1] sum of block energy.
+	int		reach;
+	double	limit;							// max window energy without a peak.
+	int		deadBlocks;
+
+	void release(void);
+
+public:
+	SignalGate(void);
+	virtual ~SignalGate(void);
+
+	int build(const float *pcm, int length, GaborKernel &kernel, int kernelBaseF, float threshold);
+	float getDeadRatio(void) { return (blocks > 0) ? (float)deadBlocks / blocks : 0.0F; }
+
+	// true: no Gabor peak can reach the threshold around pcm.
+	bool isDead(const float *pcm) {
+		if (!prefix || pcm < pcmBase + reach || pcm >= pcmBase + (blocks << kBlockShift) - reach)
+			return false;
+		int idx = (int)(pcm - pcmBase);
+		int b0 = (idx - reach) >> kBlockShift;
+		int b1 = ((idx + reach) >> kBlockShift) + 1;
+		return prefix[b1] - prefix[b0] < limit;
+	}
+};
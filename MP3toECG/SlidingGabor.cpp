@@ -0,0 +1,328 @@
+#include "stdafx.h"
+#include "SlidingGabor.h"
+
+#include <emmintrin.h>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+SlidingGabor::SlidingGabor(void)
+{
+	channels = 0;
+	lanes = 0;
+	baseF = 0;
+	stepF = 1;
+	peekShift = 0.0F;
+	decim = 1;
+	firTaps = 0;
+	firLen = 0;
+	firDelay = 0;
+	firRe = firIm = nullptr;
+	mixRotRe = mixPhRe = 1.0F;
+	mixRotIm = mixPhIm = 0.0F;
+	alpha = gain = nullptr;
+	delay = nullptr;
+	rotRe = rotIm = phRe = phIm = nullptr;
+	stRe = stIm = hist = nullptr;
+	maxDelay = 0;
+	pcm = nullptr;
+	pcmLength = 0;
+	nextIdx = 0;
+}
+
+SlidingGabor::~SlidingGabor(void)
+{
+	release();
+}
+
+void SlidingGabor::release(void)
+{
+	if (firRe)	free(firRe);
+	if (firIm)	free(firIm);
+	if (alpha)	free(alpha);
+	if (gain)	free(gain);
+	if (delay)	free(delay);
+	if (rotRe)	free(rotRe);
+	if (rotIm)	free(rotIm);
+	if (phRe)	free(phRe);
+	if (phIm)	free(phIm);
+	if (stRe)	free(stRe);
+	if (stIm)	free(stIm);
+	if (hist)	free(hist);
+	firRe = firIm = nullptr;
+	alpha = gain = nullptr;
+	delay = nullptr;
+	rotRe = rotIm = phRe = phIm = nullptr;
+	stRe = stIm = hist = nullptr;
+	channels = 0;
+}
+
+/*
+ Build the filter bank. channel frequency = minF + pitch*n (minF .. maxF).
+ sigma is the gaussian width in periods, same as the G-Table (2.0).
+ level is the factor scale of the G-Table in use.
+ */
+int SlidingGabor::setup(const float *pcmp, int length, float samplingRate,
+						int minF, int maxF, int pitch, float sigma, float level)
+{
+	release();
+
+	pcm = pcmp;
+	pcmLength = length;
+	baseF = minF;
+	stepF = pitch;
+	channels = (maxF - minF)/pitch + 1;
+	lanes = (channels + 3) & ~3;			// 4 channels a step, the rest idle.
+
+	// front end: mix to the center, low-pass and decimate. The pass band
+	// ends at half band + 120Hz (the gaussian windows of the edge channels),
+	// the stop band starts at decRate - pass, so nothing folds into the pass
+	// band and the cutoff (-6dB) is decRate/2. The transition is Hamming,
+	// 3.3/taps. The mix is moved into the taps (complex band-pass on the
+	// real PCM), so only the decimated samples are computed.
+	double centerF = (minF + maxF) / 2.0;
+	decim = (int)(samplingRate / kDecimatedRate);
+	if (decim < 1)
+		decim = 1;
+	double decRate = samplingRate / decim;
+	double pass = (maxF - minF) / 2.0 + 120.0;
+	double cutoff = decRate / 2.0;
+	double transition = decRate - 2.0*pass;
+	firTaps = ((int)(3.3 * samplingRate / transition) | 1);
+	firDelay = (firTaps - 1) / 2;
+	firLen = (firTaps + 3) & ~3;
+
+	firRe = (float *)malloc(firLen * sizeof(float));
+	firIm = (float *)malloc(firLen * sizeof(float));
+	alpha = (float *)malloc(lanes * sizeof(float));
+	gain  = (float *)malloc(channels * sizeof(float));
+	delay = (int *)malloc(channels * sizeof(int));
+	rotRe = (float *)malloc(lanes * sizeof(float));
+	rotIm = (float *)malloc(lanes * sizeof(float));
+	phRe  = (float *)malloc(lanes * sizeof(float));
+	phIm  = (float *)malloc(lanes * sizeof(float));
+	stRe  = (float *)malloc(kStages * lanes * sizeof(float));
+	stIm  = (float *)malloc(kStages * lanes * sizeof(float));
+	hist  = (float *)malloc(kHistory * lanes * sizeof(float));
+	if (!firRe || !firIm || !alpha || !gain || !delay || !rotRe || !rotIm
+		|| !phRe || !phIm || !stRe || !stIm || !hist) {
+		release();
+		return -1;
+	}
+
+	// tap t reads pcm[n - (firLen-1) + t], zeros in front up to firLen.
+	// output n = exp(-jwn) * sum(h[t] * exp(-jw(t - (firLen-1))) * pcm[..])
+	int pad = firLen - firTaps;
+	double sum = 0.0;
+	for (int i=0; i<firTaps; i++) {
+		double m = i - firDelay;
+		double w = 0.54 - 0.46*cos(2.0*M_PI*i/(firTaps - 1));
+		sum += ((m == 0) ? 2.0*cutoff/samplingRate : sin(2.0*M_PI*cutoff/samplingRate*m) / (M_PI*m)) * w;
+	}
+	for (int t=0; t<firLen; t++) {
+		double h = 0.0;
+		if (t >= pad) {
+			double m = t - pad - firDelay;
+			double w = 0.54 - 0.46*cos(2.0*M_PI*(t - pad)/(firTaps - 1));
+			h = ((m == 0) ? 2.0*cutoff/samplingRate : sin(2.0*M_PI*cutoff/samplingRate*m) / (M_PI*m)) * w / sum;
+		}
+		double ph = -2.0*M_PI*centerF/samplingRate * (t - (firLen-1));
+		firRe[t] = (float)(h * cos(ph));
+		firIm[t] = (float)(h * sin(ph));
+	}
+	mixRotRe = (float)cos(2.0*M_PI*centerF/samplingRate * decim);		// per decimated sample.
+	mixRotIm = (float)-sin(2.0*M_PI*centerF/samplingRate * decim);
+
+	maxDelay = 0;
+	for (int ch=channels; ch<lanes; ch++) {
+		alpha[ch] = 0.0F;
+		rotRe[ch] = 1.0F;
+		rotIm[ch] = 0.0F;
+	}
+	for (int ch=0; ch<channels; ch++) {
+		double freq = baseF + stepF*ch;
+		// gaussian deviation (decimated samples), split in kStages one-pole sections.
+		double dev = sigma * decRate / freq;
+		double v = dev*dev / kStages;
+		double p = ((2.0*v + 1.0) - sqrt(4.0*v + 1.0)) / (2.0*v);
+		alpha[ch] = 1.0F - (float)p;
+		delay[ch] = (int)(kStages * p / (1.0 - p) + 0.5);
+		if (delay[ch] > maxDelay)
+			maxDelay = delay[ch];
+		// unit DC gain --> gabor_transform level. (sum of window = fs/f, weight f/sqrt(f))
+		gain[ch] = (float)(level * samplingRate / sqrt(freq));
+		rotRe[ch] = (float)cos(2.0*M_PI*(freq - centerF)/decRate);
+		rotIm[ch] = (float)-sin(2.0*M_PI*(freq - centerF)/decRate);
+	}
+	// fvconvert picks the last bin above 0.999*peak, the gaussian peak is
+	// shifted by (f/(2*PI*sigma)) * sqrt(-2*log(0.999)).
+	peekShift = (float)(sqrt(-2.0*log(0.999)) / (2.0*M_PI*sigma));
+
+	if (maxDelay >= kHistory) {
+		release();
+		return -1;
+	}
+	reset(0);
+	return 0;
+}
+
+/*
+ Restart the bank a little before startIdx so that the filters are settled.
+ */
+void SlidingGabor::reset(int startIdx)
+{
+	for (int ch=0; ch<lanes; ch++) {
+		phRe[ch] = 1.0F;
+		phIm[ch] = 0.0F;
+	}
+	mixPhRe = 1.0F;
+	mixPhIm = 0.0F;
+	memset(stRe, 0, kStages * lanes * sizeof(float));
+	memset(stIm, 0, kStages * lanes * sizeof(float));
+	memset(hist, 0, kHistory * lanes * sizeof(float));
+
+	nextIdx = startIdx - maxDelay*4*decim - firTaps;
+	if (nextIdx < 0)
+		nextIdx = 0;
+}
+
+void SlidingGabor::feed(int endIdx)
+{
+	if (endIdx > pcmLength)
+		endIdx = pcmLength;
+
+	// decimated sample k is at nextIdx = k*decim, centered at nextIdx - firDelay.
+	nextIdx = (nextIdx + decim-1) / decim * decim;
+	for (; nextIdx < endIdx; nextIdx += decim) {
+		float xr = 0.0F, xi = 0.0F;
+		int first = nextIdx - (firLen-1);
+		if (first >= 0) {
+			const float *x = &pcm[first];
+			__m128 ar = _mm_setzero_ps();
+			__m128 ai = _mm_setzero_ps();
+			for (int t=0; t<firLen; t+=4) {
+				__m128 v = _mm_loadu_ps(&x[t]);
+				ar = _mm_add_ps(ar, _mm_mul_ps(v, _mm_loadu_ps(&firRe[t])));
+				ai = _mm_add_ps(ai, _mm_mul_ps(v, _mm_loadu_ps(&firIm[t])));
+			}
+			float lane[4];
+			_mm_storeu_ps(lane, ar);
+			float br = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+			_mm_storeu_ps(lane, ai);
+			float bi = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+			xr = br*mixPhRe - bi*mixPhIm;
+			xi = br*mixPhIm + bi*mixPhRe;
+		}
+		float pr = mixPhRe;
+		mixPhRe = pr*mixRotRe - mixPhIm*mixRotIm;
+		mixPhIm = pr*mixRotIm + mixPhIm*mixRotRe;
+
+		int k = nextIdx / decim;
+		float *hrow = &hist[(k & (kHistory-1))*lanes];
+		__m128 vxr = _mm_set1_ps(xr);
+		__m128 vxi = _mm_set1_ps(xi);
+		for (int ch=0; ch<lanes; ch+=4) {
+			__m128 cr = _mm_loadu_ps(&phRe[ch]);
+			__m128 ci = _mm_loadu_ps(&phIm[ch]);
+			__m128 rr = _mm_loadu_ps(&rotRe[ch]);
+			__m128 ri = _mm_loadu_ps(&rotIm[ch]);
+			_mm_storeu_ps(&phRe[ch], _mm_sub_ps(_mm_mul_ps(cr, rr), _mm_mul_ps(ci, ri)));
+			_mm_storeu_ps(&phIm[ch], _mm_add_ps(_mm_mul_ps(cr, ri), _mm_mul_ps(ci, rr)));
+
+			// base band signal --> kStages one-pole smoothing.
+			__m128 a = _mm_loadu_ps(&alpha[ch]);
+			__m128 zr = _mm_sub_ps(_mm_mul_ps(vxr, cr), _mm_mul_ps(vxi, ci));
+			__m128 zi = _mm_add_ps(_mm_mul_ps(vxr, ci), _mm_mul_ps(vxi, cr));
+			for (int st=0; st<kStages; st++) {
+				float *sr = &stRe[st*lanes + ch];
+				float *si = &stIm[st*lanes + ch];
+				__m128 vr = _mm_loadu_ps(sr);
+				__m128 vi = _mm_loadu_ps(si);
+				zr = _mm_add_ps(vr, _mm_mul_ps(_mm_sub_ps(zr, vr), a));
+				zi = _mm_add_ps(vi, _mm_mul_ps(_mm_sub_ps(zi, vi), a));
+				_mm_storeu_ps(sr, zr);
+				_mm_storeu_ps(si, zi);
+			}
+			_mm_storeu_ps(&hrow[ch], _mm_add_ps(_mm_mul_ps(zr, zr), _mm_mul_ps(zi, zi)));
+		}
+
+		// keep the phasors on the unit circle.
+		if ((k & 1023) == 0) {
+			float n = 1.0F / sqrtf(mixPhRe*mixPhRe + mixPhIm*mixPhIm);
+			mixPhRe *= n;
+			mixPhIm *= n;
+			for (int ch=0; ch<channels; ch++) {
+				float n = 1.0F / sqrtf(phRe[ch]*phRe[ch] + phIm[ch]*phIm[ch]);
+				phRe[ch] *= n;
+				phIm[ch] *= n;
+			}
+		}
+	}
+}
+
+float SlidingGabor::sqMagnitude(int ch, int centerIdx)
+{
+	return hist[((decimatedIndex(centerIdx) + delay[ch]) & (kHistory-1))*lanes + ch];
+}
+
+/*
+ Frequency of the peak around the pcm position centerIdx, -1 if no peak
+ reaches threshold. Requests are expected in ascending order.
+ */
+int SlidingGabor::estimate(int centerIdx, float threshold)
+{
+	int k = decimatedIndex(centerIdx);
+	int fedK = nextIdx / decim;
+	if (k < fedK - kHistory + maxDelay || (k - maxDelay*4)*decim > nextIdx)
+		reset(centerIdx);
+	int endIdx = (k + maxDelay) * decim + 1;
+	if (endIdx > pcmLength)
+		return -1;
+	feed(endIdx);
+
+	float peek = threshold;
+	int peek_ch = -1;
+	for (int ch=0; ch<channels; ch++) {
+		float mag = magnitude(ch, centerIdx);
+		if (mag > peek) {
+			peek = mag;
+			peek_ch = ch;
+		}
+	}
+	if (peek_ch == -1)
+		return -1;
+
+	// gaussian peak --> parabola on log scale.
+	float offset = 0.0F;
+	if (peek_ch > 0 && peek_ch < channels-1) {
+		float a = logf(magnitude(peek_ch-1, centerIdx) + 1e-20F);
+		float b = logf(peek);
+		float c = logf(magnitude(peek_ch+1, centerIdx) + 1e-20F);
+		float den = a - 2.0F*b + c;
+		if (den < 0.0F) {
+			offset = 0.5F * (a - c) / den;
+			if (offset < -0.5F) offset = -0.5F;
+			if (offset >  0.5F) offset =  0.5F;
+		}
+	}
+	else if (channels >= 3) {
+		// edge channel: one neighbour, the curvature of the next two inside.
+		// (not outside the band, as fvconvert)
+		int side = (peek_ch == 0) ? 1 : -1;
+		float b = logf(peek);
+		float c = logf(magnitude(peek_ch+side, centerIdx) + 1e-20F);
+		float d = logf(magnitude(peek_ch+2*side, centerIdx) + 1e-20F);
+		float den = b - 2.0F*c + d;
+		if (den < 0.0F) {
+			float inside = 0.5F - (c - b) / den;
+			if (inside < 0.0F) inside = 0.0F;
+			if (inside > 0.5F) inside = 0.5F;
+			offset = side * inside;
+		}
+	}
+	float freq = baseF + stepF * (peek_ch + offset);
+	freq += freq * peekShift;
+	return (int)freq;
+}
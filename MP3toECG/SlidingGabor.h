@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+ Sliding (recursive) Gabor filter bank.
+
+ The PCM is mixed once to the center of the band (complex), low-pass
+ filtered and decimated to about kDecimatedRate. (one complex FIR
+ evaluated only at the decimated samples) Each channel then
+ demodulates the decimated stream to base band and smooths it with a
+ cascade of one-pole filters. The cascade impulse response (gamma shape)
+ approximates the gaussian window of the Gabor table, so the channel
+ magnitude follows gabor_transform() while only the new samples are fed.
+ The work per input sample is 1/decim of the FIR and of the channels,
+ not channels x stages at the full rate.
+ */
+class SlidingGabor
+{
+private:
+	static const int kStages = 4;			// one-pole cascade length.
+	static const int kHistory = 1024;		// power of 2. decimated samples, must exceed max delay.
+	static const int kDecimatedRate = 4000;	// Hz, complex. (band +-640Hz around the center)
+
+	int		channels;
+	int		baseF;
+	int		stepF;
+	float	peekShift;						// same role as fvconvert peek_shift.
+
+	int		decim;							// input samples per decimated sample.
+	int		firTaps;
+	int		firLen;							// firTaps rounded up to 4. (SSE)
+	int		firDelay;						// input samples. ((firTaps-1)/2)
+	float	*firRe, *firIm;					// [firLen] low-pass x center phasor, zeros in front.
+	float	mixRotRe, mixRotIm;				// center phasor step. (decimated)
+	float	mixPhRe, mixPhIm;
+
+	int		lanes;							// channels rounded up to 4. (SSE)
+	float	*alpha;							// [lanes] 1 - pole.
+	float	*gain;							// [channels] scale to gabor_transform level.
+	int		*delay;							// [channels] group delay (decimated samples)
+	float	*rotRe, *rotIm;					// [lanes] phasor step. (decimated, offset from the center)
+	float	*phRe, *phIm;					// [lanes] current phasor.
+	float	*stRe, *stIm;					// [kStages * lanes]
+	float	*hist;							// [kHistory * lanes] squared magnitude.
+	int		maxDelay;
+
+	const float *pcm;
+	int		pcmLength;
+	int		nextIdx;						// next pcm index to feed.
+
+	void release(void);
+	void feed(int endIdx);
+	int decimatedIndex(int centerIdx) { return (centerIdx + firDelay + decim/2) / decim; }
+	float sqMagnitude(int ch, int centerIdx);
+	float magnitude(int ch, int centerIdx) { return sqrtf(sqMagnitude(ch, centerIdx)) * gain[ch]; }
+
+public:
+	SlidingGabor(void);
+	virtual ~SlidingGabor(void);
+
+	int setup(const float *pcmp, int length, float samplingRate,
+			  int minF, int maxF, int pitch, float sigma, float level);
+	void reset(int startIdx);
+	int estimate(int centerIdx, float threshold);
+};
@@ -0,0 +1,49 @@
+#include "stdafx.h"
+#include "StageTimer.h"
+
+#include <Windows.h>
+#include <psapi.h>
+
+#pragma comment(lib, "psapi.lib")
+
+StageTimer::StageTimer(void)
+{
+	for (int s=0; s<StageCount; s++) {
+		startTime[s] = 0.0;
+		totalTime[s] = 0.0;
+	}
+	createTime = now();
+}
+
+StageTimer::~StageTimer(void)
+{
+}
+
+const char *StageTimer::getName(int stage)
+{
+	static const char *names[StageCount] = {
+		"Decode", "Ffmpeg", "Load", "Channel", "Decimate", "GTable", "Prepare",
+		"Header", "Calibration", "SerialNo", "Data", "Output",
+	};
+	return (stage >= 0 && stage < StageCount) ? names[stage] : "";
+}
+
+double StageTimer::now(void)
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+}
+
+size_t StageTimer::getPeakMemory(void)
+{
+	PROCESS_MEMORY_COUNTERS pmc;
+	memset(&pmc, 0, sizeof(pmc));
+	pmc.cb = sizeof(pmc);
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+	return pmc.PeakWorkingSetSize;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ Elapsed time of the conversion stages. (QueryPerformanceCounter)
+
+ A stage may be started and stopped several times, the times are summed.
+ The total runs from the construction, so it includes the work between the
+ stages.
+ */
+class StageTimer
+{
+public:
+	enum {
+		StageDecode,						// in-process MP3 decoding.
+		StageFfmpeg,						// mp3 --> wav by ffmpeg.
+		StageLoad,							// loadSoundData
+		StageChannel,						// selectChannel
+		StageDecimate,						// decimatePcm
+		StageGTable,						// setupGTable
+		StagePrepare,						// energy gate, memo, int16 samples.
+		StageHeader,						// detectHeader
+		StageCalibration,					// analyzeCalibration
+		StageSerialNo,						// analyzeSerialNo
+		StageData,							// collectData / covertWholeData
+		StageOutput,						// outECG / outECGRaw
+		StageCount,
+	};
+
+private:
+	double	startTime[StageCount];
+	double	totalTime[StageCount];
+	double	createTime;
+
+public:
+	StageTimer(void);
+	virtual ~StageTimer(void);
+
+	void start(int stage) { startTime[stage] = now(); }
+	void stop(int stage) { totalTime[stage] += now() - startTime[stage]; }
+	double getTime(int stage) { return totalTime[stage]; }	// sec
+	double getTotal(void) { return now() - createTime; }	// sec
+	static const char *getName(int stage);
+
+	static double now(void);
+	static size_t getPeakMemory(void);		// byte, whole process.
+};
@@ -0,0 +1,324 @@
+#include "stdafx.h"
+#include "WavFile.h"
+#include "WaveFormat.h"
+
+#include <emmintrin.h>
+#include <iostream>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+WavFile::WavFile(void)
+{
+	hFile = INVALID_HANDLE_VALUE;
+	hMap = NULL;
+	view = nullptr;
+	viewSize = 0;
+	data = nullptr;
+	dataBytes = 0;
+	block = nullptr;
+	format = 0;
+	channels = 0;
+	samplingRate = 0;
+	bitsPerSample = 0;
+	blockAlign = 0;
+	frames = 0;
+}
+
+WavFile::~WavFile(void)
+{
+	close();
+}
+
+void WavFile::close(void)
+{
+	if (hMap && view)	UnmapViewOfFile(view);
+	if (hMap)	CloseHandle(hMap);
+	if (hFile != INVALID_HANDLE_VALUE)	CloseHandle(hFile);
+	if (block)	free(block);
+	hFile = INVALID_HANDLE_VALUE;
+	hMap = NULL;
+	view = nullptr;
+	viewSize = 0;
+	data = nullptr;
+	dataBytes = 0;
+	block = nullptr;
+	frames = 0;
+}
+
+/*
+ Map the WAV file read-only and parse the chunks. -1: error. (reported)
+ */
+int WavFile::open(const char *path)
+{
+	close();
+
+	hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		std::cerr << "Error! cannot open input file:" << path << "\n";
+		return -1;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0) {
+		close();
+		std::cerr << "Error! wav file '" << path << "' is broken. \n";
+		return -1;
+	}
+	hMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMap)
+		view = (const unsigned char *)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		close();
+		std::cerr << "Error! cannot map input file:" << path << "\n";
+		return -1;
+	}
+	viewSize = (size_t)size.QuadPart;
+
+	return parse(path);
+}
+
+/*
+ WAV image in memory. (server job) the image must live until close.
+ */
+int WavFile::attach(const void *image, size_t size)
+{
+	close();
+	view = (const unsigned char *)image;
+	viewSize = size;
+	return parse("(pcm)");
+}
+
+int WavFile::parse(const char *path)
+{
+	_chankHeader chk;
+	_fmtChunk fmt;
+	bool hasFmt = false;
+	size_t pos = 0;
+
+	name = path;
+	format = 0;
+	while (data == nullptr) {
+		if (pos + sizeof(chk) > viewSize) {
+			std::cerr << "Error! wav file '" << name << "' is broken. \n";
+			return -1;
+		}
+		memcpy(&chk, view + pos, sizeof(chk));
+		pos += sizeof(chk);
+		size_t chunkSize = (unsigned __int32)chk.chankSize;
+
+		if (chk.chankIdVal == CHANK_RIFF) {
+			__int32 tagWave;
+			if (pos + sizeof(tagWave) > viewSize) {
+				std::cerr << "Error! wav file '" << name << "' is broken. \n";
+				return -1;
+			}
+			memcpy(&tagWave, view + pos, sizeof(tagWave));
+			if (tagWave != CHANK_WAVE) {
+				std::cerr << "Error! wav file is not 'WAVE' format\n";
+				return -1;
+			}
+			pos += sizeof(tagWave);
+			continue;
+		}
+		if (chk.chankIdVal == CHANK_data) {
+			if (!hasFmt) {
+				std::cerr << "Error! wav file '" << name << "' has no 'fmt ' chank. \n";
+				return -1;
+			}
+			// size of a stream output (ffmpeg ... -f wav -) is not set.
+			data = view + pos;
+			dataBytes = (chunkSize <= viewSize - pos) ? chunkSize : viewSize - pos;
+			break;
+		}
+		if (chunkSize > viewSize - pos) {
+			std::cerr << "Error! wav file '" << name << "' is broken. \n";
+			return -1;
+		}
+		if (chk.chankIdVal == CHANK_fmt) {
+			if (chunkSize < sizeof(fmt)) {
+				std::cerr << "Error! 'fmt ' chank size is worng:" << chk.chankSize << "\n";
+				return -1;
+			}
+			memcpy(&fmt, view + pos, sizeof(fmt));
+			format = (unsigned __int16)fmt.wFormatTag;
+			if (format == FormatExtensible) {
+				// WAVEFORMATEXTENSIBLE: the format tag is the head of SubFormat.
+				unsigned __int16 subFormat = 0;
+				if (chunkSize >= 26)
+					memcpy(&subFormat, view + pos + 24, sizeof(subFormat));
+				format = subFormat;
+			}
+			hasFmt = true;
+		}
+		// onother chank! skip it. (word aligned)
+		pos += chunkSize + (chunkSize & 1);
+	}
+
+	channels = fmt.wChannels;
+	samplingRate = fmt.dwSamplesPerSec;
+	bitsPerSample = fmt.wBitsPerSample;
+	blockAlign = fmt.wBlockAlign;
+	if (format != FormatPCM && format != FormatFloat) {
+		std::cerr << "Error! wave file is not Linear PCM or float:" << format << "\n";
+		return -1;
+	}
+	if (channels < 1) {
+		std::cerr << "Error! wave file has no channel:" << channels << "\n";
+		return -1;
+	}
+	if ((format == FormatPCM && bitsPerSample != 16 && bitsPerSample != 24 && bitsPerSample != 32)
+		|| (format == FormatFloat && bitsPerSample != 32)) {
+		std::cerr << "Error! Sampl data size is not 16/24/32bits:" << bitsPerSample << "\n";
+		return -1;
+	}
+	if (blockAlign != channels * bitsPerSample / 8) {
+		std::cerr << "Error! wave file block size is worng:" << blockAlign << "\n";
+		return -1;
+	}
+	size_t count = dataBytes / blockAlign;
+	frames = (count > INT_MAX / 2) ? INT_MAX / 2 : (int)count;
+	return 0;
+}
+
+/*
+ count samples (interleaved) at src --> float.
+ */
+void WavFile::convertBlock(const unsigned char *src, int count, float *dst)
+{
+	int i = 0;
+
+	if (format == FormatFloat) {
+		memcpy(dst, src, count * sizeof(float));
+		return;
+	}
+	if (bitsPerSample == 16) {
+		// same value as (float)x / (float)SHRT_MAX, the division is exact IEEE.
+		const __m128 scale = _mm_set1_ps((float)SHRT_MAX);
+		for (; i+8<=count; i+=8) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + i*2));
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+			_mm_storeu_ps(&dst[i], _mm_div_ps(_mm_cvtepi32_ps(lo), scale));
+			_mm_storeu_ps(&dst[i+4], _mm_div_ps(_mm_cvtepi32_ps(hi), scale));
+		}
+		for (; i<count; i++) {
+			__int16 x;
+			memcpy(&x, src + i*2, sizeof(x));
+			dst[i] = (float)x / (float)SHRT_MAX;
+		}
+	}
+	else if (bitsPerSample == 24) {
+		// 3 bytes to the upper 24 bits of int32, shifted back with the sign.
+		const __m128 scale = _mm_set1_ps(8388607.0F);
+		for (; i+4<=count; i+=4) {
+			const unsigned char *p = src + i*3;
+			__m128i v = _mm_setr_epi32(
+				(int)(p[0] << 8 | p[1] << 16 | (unsigned)p[2] << 24),
+				(int)(p[3] << 8 | p[4] << 16 | (unsigned)p[5] << 24),
+				(int)(p[6] << 8 | p[7] << 16 | (unsigned)p[8] << 24),
+				(int)(p[9] << 8 | p[10] << 16 | (unsigned)p[11] << 24));
+			v = _mm_srai_epi32(v, 8);
+			_mm_storeu_ps(&dst[i], _mm_div_ps(_mm_cvtepi32_ps(v), scale));
+		}
+		for (; i<count; i++) {
+			const unsigned char *p = src + i*3;
+			int x = (int)(p[0] << 8 | p[1] << 16 | (unsigned)p[2] << 24) >> 8;
+			dst[i] = (float)x / 8388607.0F;
+		}
+	}
+	else {
+		// INT_MAX is not a float, divided in double.
+		const __m128d scale = _mm_set1_pd((double)INT_MAX);
+		for (; i+4<=count; i+=4) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(src + i*4));
+			__m128 lo = _mm_cvtpd_ps(_mm_div_pd(_mm_cvtepi32_pd(v), scale));
+			__m128 hi = _mm_cvtpd_ps(_mm_div_pd(_mm_cvtepi32_pd(_mm_srli_si128(v, 8)), scale));
+			_mm_storeu_ps(&dst[i], _mm_movelh_ps(lo, hi));
+		}
+		for (; i<count; i++) {
+			__int32 x;
+			memcpy(&x, src + i*4, sizeof(x));
+			dst[i] = (float)((double)x / (double)INT_MAX);
+		}
+	}
+}
+
+/*
+ convertBlock on the mapping. -1: the page cannot be read. (reported)
+ */
+int WavFile::convert(const unsigned char *src, int count, float *dst)
+{
+	__try {
+		convertBlock(src, count, dst);
+	}
+	__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+		std::cerr << "Error! cannot read wav file '" << name << "'. (I/O error)\n";
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ count frames from first, interleaved to block. -1: error. (reported)
+ */
+int WavFile::readBlock(int first, int count)
+{
+	if (!block) {
+		block = (float *)malloc((size_t)kBlockFrames * channels * sizeof(float));
+		if (!block) {
+			std::cerr << "Error! out of memory. (wav block)\n";
+			return -1;
+		}
+	}
+	return convert(data + (size_t)first*blockAlign, count * channels, block);
+}
+
+/*
+ All frames to mix. (down mix of the channels) -1: error. (reported)
+ */
+int WavFile::read(float *mix)
+{
+	for (int f=0; f<frames; f+=kBlockFrames) {
+		int count = (frames - f < kBlockFrames) ? frames - f : kBlockFrames;
+		if (channels == 1) {
+			if (convert(data + (size_t)f*blockAlign, count, &mix[f]))
+				return -1;
+			continue;
+		}
+		if (readBlock(f, count))
+			return -1;
+		float scale = 1.0F / channels;
+		const float *src = block;
+		for (int i=0; i<count; i++) {
+			float sum = 0.0F;
+			for (int c=0; c<channels; c++)
+				sum += *src++;
+			mix[f + i] = sum * scale;
+		}
+	}
+	return 0;
+}
+
+/*
+ Frames [first, first+count) of a channel to dst. channel -1: half the
+ difference of the first two. (stereo) -1: error. (reported)
+ */
+int WavFile::readChannel(int channel, int first, int count, float *dst)
+{
+	for (int f=0; f<count; f+=kBlockFrames) {
+		int n = (count - f < kBlockFrames) ? count - f : kBlockFrames;
+		if (readBlock(first + f, n))
+			return -1;
+		const float *src = block;
+		if (channel < 0) {
+			for (int i=0; i<n; i++, src+=channels)
+				dst[f + i] = (src[0] - src[1]) * 0.5F;
+		}
+		else {
+			for (int i=0; i<n; i++, src+=channels)
+				dst[f + i] = src[channel];
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <Windows.h>
+#include <string>
+
+/*
+ WAV file read in place. (loadSoundData, setSoundData)
+
+ The file is mapped read-only and the RIFF chunks are parsed in the
+ mapping, so the samples are not copied before the conversion: read()
+ converts kBlockFrames frames at a time from the mapped 'data' chunk
+ straight into the float buffer of the analysis (SSE2), a large WAV
+ streams from the system file cache. readChannel() converts a range of
+ one channel on request (selectChannel), no channel is kept as a whole.
+ A WAV image in memory (server PCM job) is used the same way by attach().
+
+   format 1      : linear PCM 16 / 24 / 32 bit
+   format 3      : IEEE float 32 bit
+   format 0xFFFE : extensible, the sub format is one of the above.
+
+ The samples are scaled by the largest positive value (2^(bits-1) - 1),
+ 16 bit by SHRT_MAX as before. An I/O error of the mapping (network
+ drive, file cut) is reported as a read error, not as an exception.
+ */
+class WavFile
+{
+public:
+	static const int kBlockFrames = 4096;
+	enum {
+		FormatPCM = 1,
+		FormatFloat = 3,
+		FormatExtensible = 0xFFFE,
+	};
+
+private:
+	HANDLE	hFile;
+	HANDLE	hMap;
+	const unsigned char *view;				// mapping or attached image.
+	size_t	viewSize;
+	const unsigned char *data;				// 'data' chunk in view.
+	size_t	dataBytes;
+	float	*block;							// interleaved frames. (multi-channel)
+	std::string name;						// for the messages.
+
+	int		format;							// FormatPCM / FormatFloat
+	int		channels;
+	int		samplingRate;
+	int		bitsPerSample;
+	int		blockAlign;
+	int		frames;
+
+	int parse(const char *name);
+	void convertBlock(const unsigned char *src, int count, float *dst);
+	int convert(const unsigned char *src, int count, float *dst);
+	int readBlock(int first, int count);
+
+public:
+	WavFile(void);
+	virtual ~WavFile(void);
+
+	int open(const char *path);
+	int attach(const void *image, size_t size);
+	void close(void);
+	int read(float *mix);
+	int readChannel(int channel, int first, int count, float *dst);
+
+	int getFormat(void) { return format; }
+	int getChannels(void) { return channels; }
+	int getSamplingRate(void) { return samplingRate; }
+	int getBitsPerSample(void) { return bitsPerSample; }
+	int getFrames(void) { return frames; }
+};
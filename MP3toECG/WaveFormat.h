@@ -0,0 +1,27 @@
+#pragma once
+
+/*
+ RIFF WAVE chunks. (loadSoundData, PcmStream)
+ */
+typedef struct {
+	union {
+		char	chankId[4];
+		__int32 chankIdVal;
+	};
+	__int32	chankSize;
+} _chankHeader;
+
+#define CHANK_RIFF	0x46464952		//  'RIFF'
+#define CHANK_WAVE	0x45564157		//  'WAVE'
+#define CHANK_fmt	0x20746d66		//	'fmt '
+#define CHANK_data	0x61746164		//	'data'
+
+
+typedef struct {
+	__int16	 wFormatTag;		// LinearPCM:	1
+	__int16	 wChannels;			// Monoral:		1
+	__int32	 dwSamplesPerSec;	// 44100
+	__int32	 dwAvgBytesPerSec;	// 44100*2
+	__int16 wBlockAlign;		// 2
+	__int16 wBitsPerSample;		// 16
+} _fmtChunk;